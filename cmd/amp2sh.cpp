@@ -82,16 +82,16 @@ using value_type = float;
 
 class Amp2SHCommon { MEMALIGN(Amp2SHCommon)
   public:
-    template <class MatrixType>
-      Amp2SHCommon (const MatrixType& sh2amp,
-          const vector<size_t>& bzeros, 
-          const vector<size_t>& dwis, 
-          bool normalise_to_bzero) :
-        sh2amp (sh2amp), 
-        amp2sh (Math::pinv (sh2amp)),
-        bzeros (bzeros),
-        dwis (dwis),
-        normalise (normalise_to_bzero) { }
+    Amp2SHCommon (const Eigen::MatrixXd& dirs,
+        const int lmax,
+        const vector<size_t>& bzeros, 
+        const vector<size_t>& dwis, 
+        bool normalise_to_bzero) :
+      bzeros (bzeros),
+      dwis (dwis),
+      normalise (normalise_to_bzero) {
+        Math::SH::cached_transform (dirs, lmax, sh2amp, amp2sh);
+      }
 
 
     Eigen::MatrixXd sh2amp, amp2sh;
@@ -236,7 +236,7 @@ void run ()
   }
   PhaseEncoding::clear_scheme (header);
 
-  auto sh2amp = DWI::compute_SH2amp_mapping (dirs, true, 8);
+  const int lmax = Math::SH::LforN (DWI::compute_SH2amp_mapping (dirs, true, 8).cols());
 
 
   bool normalise = get_options ("normalise").size();
@@ -244,11 +244,11 @@ void run ()
     throw Exception ("the normalise option is only available if the input data contains b=0 images.");
 
 
-  header.size (3) = sh2amp.cols();
+  header.size (3) = Math::SH::NforL (lmax);
   Stride::set_from_command_line (header);
   auto SH = Image<value_type>::create (argument[1], header);
 
-  Amp2SHCommon common (sh2amp, bzeros, dwis, normalise);
+  Amp2SHCommon common (dirs, lmax, bzeros, dwis, normalise);
 
   opt = get_options ("rician");
   if (opt.size()) {
@@ -102,63 +102,85 @@ void usage ()
 
 class CSD_Processor { MEMALIGN(CSD_Processor)
   public:
-    CSD_Processor (const DWI::SDeconv::CSD::Shared& shared, Image<bool>& mask) :
+    CSD_Processor (const DWI::SDeconv::CSD::Shared& shared, Image<float>& dwi, Image<float>& fod, Image<bool>& mask, size_t axis) :
       sdeconv (shared),
-      data (shared.dwis.size()),
-      mask (mask) { }
-
-
-    void operator () (Image<float>& dwi, Image<float>& fod) {
-      if (!load_data (dwi)) {
-        for (auto l = Loop (3) (fod); l; ++l)
-          fod.value() = 0.0;
-        return;
+      dwi (dwi),
+      fod (fod),
+      mask (mask),
+      axis (axis) { }
+
+
+    // deconvolve all voxels along a line of the image as a single batch:
+    void operator () (const Iterator& pos) {
+      assign_pos_of (pos).to (dwi, fod);
+      load_data();
+
+      if (voxels.size()) {
+        sdeconv.solve_batch (data.leftCols (voxels.size()), FODs, num_iterations);
+        for (size_t v = 0; v < voxels.size(); ++v) {
+          if (sdeconv.shared.niter && num_iterations[v] >= sdeconv.shared.niter) {
+            dwi.index (axis) = voxels[v];
+            INFO ("voxel [ " + str (dwi.index(0)) + " " + str (dwi.index(1)) + " " + str (dwi.index(2)) +
+                " ] did not reach full convergence");
+          }
+        }
       }
 
-      sdeconv.set (data);
-
-      size_t n;
-      for (n = 0; n < sdeconv.shared.niter; n++)
-        if (sdeconv.iterate())
-          break;
-
-      if (sdeconv.shared.niter && n >= sdeconv.shared.niter)
-        INFO ("voxel [ " + str (dwi.index(0)) + " " + str (dwi.index(1)) + " " + str (dwi.index(2)) +
-            " ] did not reach full convergence");
-
-      write_back (fod);
+      write_back();
     }
 
 
   private:
     DWI::SDeconv::CSD sdeconv;
-    Eigen::VectorXd data;
+    Image<float> dwi, fod;
     Image<bool> mask;
-
-
-    bool load_data (Image<float>& dwi) {
-      if (mask.valid()) {
-        assign_pos_of (dwi, 0, 3).to (mask);
-        if (!mask.value())
-          return false;
-      }
-
-      for (size_t n = 0; n < sdeconv.shared.dwis.size(); n++) {
-        dwi.index(3) = sdeconv.shared.dwis[n];
-        data[n] = dwi.value();
-        if (!std::isfinite (data[n]))
-          return false;
-        if (data[n] < 0.0)
-          data[n] = 0.0;
+    const size_t axis;
+    Eigen::MatrixXd data, FODs;
+    vector<ssize_t> voxels;
+    vector<size_t> num_iterations;
+
+
+    void load_data () {
+      data.resize (sdeconv.shared.dwis.size(), dwi.size (axis));
+      voxels.clear();
+      for (auto l = Loop (axis) (dwi); l; ++l) {
+        if (mask.valid()) {
+          assign_pos_of (dwi, 0, 3).to (mask);
+          if (!mask.value())
+            continue;
+        }
+
+        auto column = data.col (voxels.size());
+        bool valid = true;
+        for (size_t n = 0; n < sdeconv.shared.dwis.size(); n++) {
+          dwi.index(3) = sdeconv.shared.dwis[n];
+          column[n] = dwi.value();
+          if (!std::isfinite (column[n])) {
+            valid = false;
+            break;
+          }
+          if (column[n] < 0.0)
+            column[n] = 0.0;
+        }
+        if (valid)
+          voxels.push_back (dwi.index (axis));
       }
-
-      return true;
     }
 
 
-    void write_back (Image<float>& fod) {
-      for (auto l = Loop (3) (fod); l; ++l)
-        fod.value() = sdeconv.FOD() [fod.index(3)];
+    void write_back () {
+      size_t v = 0;
+      for (auto l = Loop (axis) (fod); l; ++l) {
+        if (v < voxels.size() && fod.index (axis) == voxels[v]) {
+          for (auto l2 = Loop (3) (fod); l2; ++l2)
+            fod.value() = FODs (fod.index(3), v);
+          ++v;
+        }
+        else {
+          for (auto l2 = Loop (3) (fod); l2; ++l2)
+            fod.value() = 0.0;
+        }
+      }
     }
 
 };
@@ -168,15 +190,87 @@ class CSD_Processor { MEMALIGN(CSD_Processor)
 
 class MSMT_Processor { MEMALIGN (MSMT_Processor)
   public:
-    MSMT_Processor (const DWI::SDeconv::MSMT_CSD::Shared& shared, Image<bool>& mask_image, vector< Image<float> > odf_images) :
-        sdeconv (shared),
+    class Statistics { NOMEMALIGN
+      public:
+        Statistics () : num_voxels (0), total_iterations (0), max_iterations (0) { }
+
+        void add (size_t voxels, size_t iterations, size_t max) {
+          std::lock_guard<std::mutex> lock (mutex);
+          num_voxels += voxels;
+          total_iterations += iterations;
+          max_iterations = std::max (max_iterations, max);
+        }
+
+        void report () const {
+          if (num_voxels)
+            INFO ("ICLS iterations per voxel: mean " + str (default_type (total_iterations) / default_type (num_voxels))
+                + ", max " + str (max_iterations) + " (over " + str (num_voxels) + " voxels)");
+        }
+
+      private:
+        size_t num_voxels, total_iterations, max_iterations;
+        std::mutex mutex;
+    };
+
+
+    MSMT_Processor (const DWI::SDeconv::MSMT_CSD::Shared& shared, Image<float>& dwi_image, Image<bool>& mask_image,
+                    vector< Image<float> > odf_images, size_t axis, std::shared_ptr<Statistics> stats) :
+        sdeconv (shared, true),
+        dwi_image (dwi_image),
         mask_image (mask_image),
         odf_images (odf_images),
         dwi_data (shared.grad.rows()),
-        output_data (shared.problem.H.cols()) { }
+        output_data (shared.problem.H.cols()),
+        axis (axis),
+        stats (stats),
+        num_voxels (0),
+        total_iterations (0),
+        max_iterations (0) { }
+
+    MSMT_Processor (const MSMT_Processor& that) :
+        sdeconv (that.sdeconv),
+        dwi_image (that.dwi_image),
+        mask_image (that.mask_image),
+        odf_images (that.odf_images),
+        dwi_data (that.dwi_data),
+        output_data (that.output_data),
+        axis (that.axis),
+        stats (that.stats),
+        num_voxels (0),
+        total_iterations (0),
+        max_iterations (0) { }
+
+    ~MSMT_Processor () {
+      stats->add (num_voxels, total_iterations, max_iterations);
+    }
+
+
+    // process all voxels along a line of the image, warm-starting the solver
+    // from the previous voxel along the line. The active set is reset at the
+    // start of each line, so that the output does not depend on how lines
+    // are distributed across threads:
+    void operator() (const Iterator& pos)
+    {
+      assign_pos_of (pos).to (dwi_image);
+      sdeconv.reset();
+      for (auto l = Loop (axis) (dwi_image); l; ++l)
+        process();
+    }
+
+
+  private:
+    DWI::SDeconv::MSMT_CSD sdeconv;
+    Image<float> dwi_image;
+    Image<bool> mask_image;
+    vector< Image<float> > odf_images;
+    Eigen::VectorXd dwi_data;
+    Eigen::VectorXd output_data;
+    const size_t axis;
+    std::shared_ptr<Statistics> stats;
+    size_t num_voxels, total_iterations, max_iterations;
 
 
-    void operator() (Image<float>& dwi_image)
+    void process ()
     {
       if (mask_image.valid()) {
         assign_pos_of (dwi_image, 0, 3).to (mask_image);
@@ -192,6 +286,9 @@ class MSMT_Processor { MEMALIGN (MSMT_Processor)
         INFO ("voxel [ " + str (dwi_image.index(0)) + " " + str (dwi_image.index(1)) + " " + str (dwi_image.index(2)) +
             " ] did not reach full convergence");
       }
+      ++num_voxels;
+      total_iterations += sdeconv.niter;
+      max_iterations = std::max (max_iterations, sdeconv.niter);
 
       size_t j = 0;
       for (size_t i = 0; i < odf_images.size(); ++i) {
@@ -200,14 +297,6 @@ class MSMT_Processor { MEMALIGN (MSMT_Processor)
           odf_images[i].value() = output_data[j++];
       }
     }
-
-
-  private:
-    DWI::SDeconv::MSMT_CSD sdeconv;
-    Image<bool> mask_image;
-    vector< Image<float> > odf_images;
-    Eigen::VectorXd dwi_data;
-    Eigen::VectorXd output_data;
 };
 
 
@@ -254,10 +343,10 @@ void run ()
     PhaseEncoding::clear_scheme (header_out);
     auto fod = Image<float>::create (argument[3], header_out);
 
-    CSD_Processor processor (shared, mask);
     auto dwi = header_in.get_image<float>().with_direct_io (3);
-    ThreadedLoop ("performing constrained spherical deconvolution", dwi, 0, 3)
-        .run (processor, dwi, fod);
+    auto loop = ThreadedLoop ("performing constrained spherical deconvolution", dwi, 0, 3);
+    CSD_Processor processor (shared, dwi, fod, mask, loop.inner_axes[0]);
+    loop.run_outer (processor);
 
   } else if (algorithm == 1) {
 
@@ -291,10 +380,14 @@ void run ()
       odfs.push_back (Image<float> (Image<float>::create (odf_paths[i], header_out)));
     }
 
-    MSMT_Processor processor (shared, mask, odfs);
-    auto dwi = header_in.get_image<float>().with_direct_io (3);
-    ThreadedLoop ("performing multi-shell, multi-tissue CSD", dwi, 0, 3)
-        .run (processor, dwi);
+    auto stats = std::make_shared<MSMT_Processor::Statistics>();
+    {
+      auto dwi = header_in.get_image<float>().with_direct_io (3);
+      auto loop = ThreadedLoop ("performing multi-shell, multi-tissue CSD", dwi, 0, 3);
+      MSMT_Processor processor (shared, dwi, mask, odfs, loop.inner_axes[0], stats);
+      loop.run_outer (processor);
+    }
+    stats->report();
 
   } else {
     assert (0);
@@ -17,7 +17,7 @@
 #include "phase_encoding.h"
 #include "progressbar.h"
 #include "image.h"
-#include "algo/threaded_copy.h"
+#include "algo/threaded_loop.h"
 #include "dwi/gradient.h"
 #include "dwi/tensor.h"
 
@@ -72,107 +72,154 @@ void usage ()
 
 }
 
-template <class MASKType, class B0Type, class DKTType, class PredictType>
+// Fits all voxels along a line of the image as a single block. The number of
+// model parameters NP (7 for DTI, 22 for DKI, including the log-b0 term) is
+// fixed at compile time, so that the per-voxel normal equations and their
+// Cholesky decomposition use fixed-size matrices and need no allocation; the
+// log / exp steps and the model predictions are evaluated for the whole block
+// at once.
+template <int NP>
 class Processor { MEMALIGN(Processor)
   public:
-    Processor (const Eigen::MatrixXd& b, const int iter, MASKType* mask_image, B0Type* b0_image, DKTType* dkt_image, PredictType* predict_image) :
+    using design_type = Eigen::Matrix<double,Eigen::Dynamic,NP>;
+    using normal_type = Eigen::Matrix<double,NP,NP>;
+
+    Processor (const Eigen::MatrixXd& b, const int iter, Image<value_type>& dwi_image, Image<value_type>& dt_image,
+        Image<bool>& mask_image, Image<value_type>& b0_image, Image<value_type>& dkt_image, Image<value_type>& predict_image, size_t axis) :
+      dwi_image (dwi_image),
+      dt_image (dt_image),
       mask_image (mask_image),
       b0_image (b0_image),
       dkt_image (dkt_image),
       predict_image (predict_image),
-      dwi(b.rows()),
-      p(b.cols()),
-      w(b.rows()),
-      work(b.cols(),b.cols()),
-      llt(work.rows()),
-      b(b),
-      maxit(iter) { }
-
-    template <class DWIType, class DTType>
-      void operator() (DWIType& dwi_image, DTType& dt_image)
-      {
-        if (mask_image) {
-          assign_pos_of (dwi_image, 0, 3).to (*mask_image);
-          if (!mask_image->value())
-            return;
-        }
-        
-        for (auto l = Loop (3) (dwi_image); l; ++l)
-          dwi[dwi_image.index(3)] = dwi_image.value();
-        
-        double small_intensity = 1.0e-6 * dwi.maxCoeff(); 
-        for (int i = 0; i < dwi.rows(); i++) {
-          if (dwi[i] < small_intensity)
-            dwi[i] = small_intensity;
-          dwi[i] = std::log (dwi[i]);
-        }
-        
-        work.setZero();
-        work.selfadjointView<Eigen::Lower>().rankUpdate (b.transpose());
-        p = llt.compute (work.selfadjointView<Eigen::Lower>()).solve(b.transpose()*dwi);
-        for (int it = 0; it < maxit; it++) {
-          w = (b*p).array().exp();
-          work.setZero();
-          work.selfadjointView<Eigen::Lower>().rankUpdate (b.transpose()*w.asDiagonal());
-          p = llt.compute (work.selfadjointView<Eigen::Lower>()).solve(b.transpose()*w.asDiagonal()*w.asDiagonal()*dwi);
+      axis (axis),
+      b (b),
+      bt (b.transpose()),
+      bw (NP, b.rows()),
+      maxit (iter)
+    {
+      normal_type work = normal_type::Zero();
+      work.template selfadjointView<Eigen::Lower>().rankUpdate (bt);
+      ols.compute (work);
+    }
+
+    void operator() (const Iterator& pos)
+    {
+      assign_pos_of (pos).to (dwi_image, dt_image);
+      load_data();
+      if (voxels.empty())
+        return;
+
+      const ssize_t nvox = voxels.size();
+      auto S = dwi.leftCols (nvox);
+      auto P = params.leftCols (nvox);
+
+      // ordinary least-squares estimate: identical normal equations for all voxels
+      P.noalias() = ols.solve (bt * S);
+
+      for (int it = 0; it < maxit; it++) {
+        w.resize (b.rows(), nvox);
+        w.noalias() = b * P;
+        w = w.array().exp();
+        for (ssize_t v = 0; v < nvox; ++v) {
+          bw.noalias() = bt * w.col(v).asDiagonal();
+          normal_type work = normal_type::Zero();
+          work.template selfadjointView<Eigen::Lower>().rankUpdate (bw);
+          llt.compute (work);
+          P.col(v) = llt.solve (bw * (w.col(v).array() * S.col(v).array()).matrix());
         }
-        
-        if (b0_image) {
-          assign_pos_of (dwi_image, 0, 3).to (*b0_image);
-          b0_image->value() = exp(p[6]);
+      }
+
+      if (predict_image.valid()) {
+        w.resize (b.rows(), nvox);
+        w.noalias() = b * P;
+        w = w.array().exp();
+      }
+
+      write_back();
+    }
+
+  private:
+    Image<value_type> dwi_image, dt_image;
+    Image<bool> mask_image;
+    Image<value_type> b0_image, dkt_image, predict_image;
+    const size_t axis;
+    const design_type b;
+    const Eigen::Matrix<double,NP,Eigen::Dynamic> bt;
+    Eigen::Matrix<double,NP,Eigen::Dynamic> bw, params;
+    Eigen::MatrixXd dwi, w;
+    Eigen::LLT<normal_type> ols, llt;
+    vector<ssize_t> voxels;
+    const int maxit;
+
+    void load_data ()
+    {
+      dwi.resize (b.rows(), dwi_image.size (axis));
+      params.resize (NP, dwi_image.size (axis));
+      voxels.clear();
+      for (auto l = Loop (axis) (dwi_image); l; ++l) {
+        if (mask_image.valid()) {
+          assign_pos_of (dwi_image, 0, 3).to (mask_image);
+          if (!mask_image.value())
+            continue;
         }
-        
-        for (auto l = Loop(3)(dt_image); l; ++l) {
+        auto column = dwi.col (voxels.size());
+        for (auto l2 = Loop (3) (dwi_image); l2; ++l2)
+          column[dwi_image.index(3)] = dwi_image.value();
+        const double small_intensity = 1.0e-6 * column.maxCoeff();
+        column = column.array().max (small_intensity).log();
+        voxels.push_back (dwi_image.index (axis));
+      }
+    }
+
+    void write_back ()
+    {
+      for (size_t v = 0; v < voxels.size(); ++v) {
+        dt_image.index (axis) = voxels[v];
+        const auto p = params.col (v);
+        for (auto l = Loop(3)(dt_image); l; ++l)
           dt_image.value() = p[dt_image.index(3)];
+
+        if (b0_image.valid()) {
+          assign_pos_of (dt_image, 0, 3).to (b0_image);
+          b0_image.value() = std::exp (p[6]);
         }
-        
-        if (dkt_image) {
-          assign_pos_of (dwi_image, 0, 3).to (*dkt_image);
+
+        if (dkt_image.valid()) {
+          assign_pos_of (dt_image, 0, 3).to (dkt_image);
           double adc_sq = (p[0]+p[1]+p[2])*(p[0]+p[1]+p[2])/9.0;
-          for (auto l = Loop(3)(*dkt_image); l; ++l) {
-            dkt_image->value() = p[dkt_image->index(3)+7]/adc_sq;
-          }
+          for (auto l = Loop(3)(dkt_image); l; ++l)
+            dkt_image.value() = p[dkt_image.index(3)+7]/adc_sq;
         }
-        
-        if (predict_image) {
-          assign_pos_of (dwi_image, 0, 3).to (*predict_image);
-          dwi = (b*p).array().exp();
-          for (auto l = Loop(3)(*predict_image); l; ++l) {
-            predict_image->value() = dwi[predict_image->index(3)];
-          }
+
+        if (predict_image.valid()) {
+          assign_pos_of (dt_image, 0, 3).to (predict_image);
+          for (auto l = Loop(3)(predict_image); l; ++l)
+            predict_image.value() = w (predict_image.index(3), v);
         }
-        
       }
-
-  private:
-    copy_ptr<MASKType> mask_image;
-    copy_ptr<B0Type> b0_image;
-    copy_ptr<DKTType> dkt_image;
-    copy_ptr<PredictType> predict_image;
-    Eigen::VectorXd dwi;
-    Eigen::VectorXd p;
-    Eigen::VectorXd w;
-    Eigen::MatrixXd work;
-    Eigen::LLT<Eigen::MatrixXd> llt;
-    const Eigen::MatrixXd& b;
-    const int maxit;
+    }
 };
 
-template <class MASKType, class B0Type, class DKTType, class PredictType> 
-inline Processor<MASKType, B0Type, DKTType, PredictType> processor (const Eigen::MatrixXd& b, const int& iter, MASKType* mask_image, B0Type* b0_image, DKTType* dkt_image, PredictType* predict_image) {
-  return { b, iter, mask_image, b0_image, dkt_image, predict_image };
+template <int NP>
+inline void run_processor (const Eigen::MatrixXd& b, const int iter, Image<value_type>& dwi, Image<value_type>& dt,
+    Image<bool>& mask, Image<value_type>& b0, Image<value_type>& dkt, Image<value_type>& predict)
+{
+  auto loop = ThreadedLoop ("computing tensors", dwi, 0, 3);
+  Processor<NP> processor (b, iter, dwi, dt, mask, b0, dkt, predict, loop.inner_axes[0]);
+  loop.run_outer (processor);
 }
 
 void run ()
 {
-  auto dwi = Header::open (argument[0]).get_image<value_type>();
+  auto dwi = Header::open (argument[0]).get_image<value_type>().with_direct_io (3);
   auto grad = DWI::get_valid_DW_scheme (dwi);
   
-  Image<bool>* mask = nullptr;
+  Image<bool> mask;
   auto opt = get_options ("mask");
   if (opt.size()) {
-    mask = new Image<bool> (Image<bool>::open (opt[0][0]));
-    check_dimensions (dwi, *mask, 0, 3);
+    mask = Image<bool>::open (opt[0][0]);
+    check_dimensions (dwi, mask, 0, 3);
   }
   
   auto iter = get_option_value ("iter", DEFAULT_NITER);
@@ -183,32 +230,33 @@ void run ()
   DWI::stash_DW_scheme (header, grad);
   PhaseEncoding::clear_scheme (header);
   
-  Image<value_type>* predict = nullptr;
+  Image<value_type> predict;
   opt = get_options ("predicted_signal");
-  if (opt.size()) {
-    predict = new Image<value_type> (Image<value_type>::create (opt[0][0], header));
-  }
+  if (opt.size())
+    predict = Image<value_type>::create (opt[0][0], header);
   
   header.size(3) = 6;
   auto dt = Image<value_type>::create (argument[1], header);
 
-  Image<value_type>* b0 = nullptr;
+  Image<value_type> b0;
   opt = get_options ("b0");
   if (opt.size()) {
     header.ndim() = 3;
-    b0 = new Image<value_type> (Image<value_type>::create (opt[0][0], header));
+    b0 = Image<value_type>::create (opt[0][0], header);
   }
 
-  Image<value_type>* dkt = nullptr;
+  Image<value_type> dkt;
   opt = get_options ("dkt");
   if (opt.size()) {
     header.ndim() = 4;
     header.size(3) = 15;
-    dkt = new Image<value_type> (Image<value_type>::create (opt[0][0], header));
+    dkt = Image<value_type>::create (opt[0][0], header);
   }
   
-  Eigen::MatrixXd b = -DWI::grad2bmatrix<double> (grad, opt.size()>0);
+  Eigen::MatrixXd b = -DWI::grad2bmatrix<double> (grad, dkt.valid());
 
-  ThreadedLoop("computing tensors", dwi, 0, 3).run (processor (b, iter, mask, b0, dkt, predict), dwi, dt);
+  if (dkt.valid())
+    run_processor<22> (b, iter, dwi, dt, mask, b0, dkt, predict);
+  else
+    run_processor<7> (b, iter, dwi, dt, mask, b0, dkt, predict);
 }
-
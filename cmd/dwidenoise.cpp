@@ -17,13 +17,25 @@
 #include "image.h"
 #include <Eigen/Dense>
 #include <Eigen/Eigenvalues>
+#include <algorithm>
+#include <numeric>
+#include <atomic>
+#include <mutex>
 
 #define DEFAULT_SIZE 5
+#define DENOISE_MAX_QR_ITERATIONS 30
+#define DENOISE_APPROX_CHECK_INTERVAL 50
+#define DENOISE_LANCZOS_MIN_STEPS 32
+#define DENOISE_LANCZOS_STEP_RATIO 4
+#define DENOISE_LANCZOS_TOLERANCE 1.0e-6
 
 using namespace MR;
 using namespace App;
 
 
+const char* const eigensolvers[] = { "exact", "approximate", nullptr };
+
+
 void usage ()
 {
   SYNOPSIS = "Denoise DWI data and estimate the noise level based on the optimal threshold for PCA";
@@ -63,7 +75,15 @@ void usage ()
     +   Argument ("window").type_sequence_int ()
 
     + Option ("noise", "the output noise map.")
-    +   Argument ("level").type_image_out();
+    +   Argument ("level").type_image_out()
+
+    + Option ("eigensolver", "the eigensolver used for the PCA decomposition; options are: " + join(eigensolvers, ", ") + ". "
+              "The approximate solver computes only the largest components, using a Lanczos decomposition of the "
+              "covariance matrix, and relies on its trace to determine the noise level; it falls back to the exact "
+              "solver in voxels where the retained components cannot be resolved. This is faster for large windows "
+              "and many volumes, but does not exactly reproduce the output of the exact solver: when in use, the "
+              "deviation of its output from the exact solution is reported for a subset of voxels. (default: exact)")
+    +   Argument ("type").type_choice (eigensolvers);
 
   COPYRIGHT = "Copyright (c) 2016 New York University, University of Antwerp, and the MRtrix3 contributors \n \n"
       "Permission is hereby granted, free of charge, to any non-commercial entity ('Recipient') obtaining a copy of this software and "
@@ -88,40 +108,151 @@ void usage ()
 using value_type = float;
 
 
+// number of voxels in which the tridiagonal QR iteration failed to converge:
+std::atomic<size_t> num_unconverged (0);
+
+
+// Keeps track of the use of the approximate eigensolver, and of its deviation
+// from the exact solution in the subset of voxels where both are computed:
+class ApproximationStats { NOMEMALIGN
+  public:
+    ApproximationStats () : num_approximated (0), num_exact (0), num_checked (0),
+        output_sum (0.0), output_max (0.0), noise_sum (0.0), noise_max (0.0) { }
+
+    void count (bool approximated) {
+      if (approximated) ++num_approximated;
+      else ++num_exact;
+    }
+
+    void add (const Eigen::VectorXf& approx, const Eigen::VectorXf& exact, double approx_sigma2, double exact_sigma2) {
+      const double output_dev = (approx - exact).norm() / exact.norm();
+      const double noise_dev = std::abs (std::sqrt (approx_sigma2) - std::sqrt (exact_sigma2)) / std::sqrt (exact_sigma2);
+      std::lock_guard<std::mutex> lock (mutex);
+      ++num_checked;
+      if (std::isfinite (output_dev)) {
+        output_sum += output_dev;
+        output_max = std::max (output_max, output_dev);
+      }
+      if (std::isfinite (noise_dev)) {
+        noise_sum += noise_dev;
+        noise_max = std::max (noise_max, noise_dev);
+      }
+    }
+
+    void report () const {
+      CONSOLE ("approximate eigensolver used in " + str(num_approximated.load()) + " of "
+          + str(num_approximated.load() + num_exact.load()) + " voxels");
+      if (num_checked)
+        CONSOLE ("relative deviation from exact solution over " + str(num_checked) + " sampled voxels: "
+            "denoised signal mean " + str(output_sum / num_checked) + ", max " + str(output_max)
+            + "; noise level mean " + str(noise_sum / num_checked) + ", max " + str(noise_max));
+    }
+
+  private:
+    std::atomic<size_t> num_approximated, num_exact;
+    size_t num_checked;
+    double output_sum, output_max, noise_sum, noise_max;
+    std::mutex mutex;
+};
+
+
+
 template <class ImageType>
 class DenoisingFunctor { MEMALIGN(DenoisingFunctor)
   public:
-  DenoisingFunctor (ImageType& dwi, vector<int> extent, Image<bool>& mask, ImageType& noise)
+  DenoisingFunctor (ImageType& dwi, vector<int> extent, Image<bool>& mask, ImageType& noise,
+                    std::shared_ptr<ApproximationStats> stats = nullptr)
     : extent {{extent[0]/2, extent[1]/2, extent[2]/2}},
       m (dwi.size(3)),
       n (extent[0]*extent[1]*extent[2]),
       r ((m<n) ? m : n),
       X (m,n), 
+      XtX (r,r),
+      centre (m),
+      s (r),
+      order (r),
       pos {{0, 0, 0}}, 
+      gram_valid (false),
+      approximate (stats),
+      num_approximated (0),
       mask (mask),
-      noise (noise)
+      noise (noise),
+      stats (stats)
   { }
   
   void operator () (ImageType& dwi, ImageType& out)
   {
     if (mask.valid()) {
       assign_pos_of (dwi).to (mask);
-      if (!mask.value())
+      if (!mask.value()) {
+        gram_valid = false;
         return;
+      }
     }
 
-    // Load data in local window
-    load_data (dwi);
-
     // Compute Eigendecomposition:
-    Eigen::MatrixXf XtX (r,r);
-    if (m <= n)
-      XtX.template triangularView<Eigen::Lower>() = X * X.transpose();
-    else 
-      XtX.template triangularView<Eigen::Lower>() = X.transpose() * X;
-    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXf> eig (XtX);
+    if (m <= n) {
+      // X*X^T is updated incrementally as the window slides through the image:
+      update_gram (dwi);
+      XtX.template triangularView<Eigen::Lower>() = gram;
+      centre = X.col (n/2);
+    }
+    else {
+      load_data (dwi);
+      XtX.template triangularView<Eigen::Lower>() = X.transpose().template cast<double>() * X.template cast<double>();
+      if (approximate)
+        gram = XtX;
+    }
+    const bool approximated = approximate && approximate_projection();
+    if (approximate)
+      stats->count (approximated);
+    if (!approximated)
+      exact_projection();
+    else if (!(++num_approximated % DENOISE_APPROX_CHECK_INTERVAL)) {
+      // compare against the exact solution for a subset of voxels:
+      const Eigen::VectorXf approx = centre;
+      const double approx_sigma2 = sigma2;
+      if (m <= n)
+        centre = X.col (n/2);
+      exact_projection();
+      stats->add (approx, centre, approx_sigma2, sigma2);
+      centre = approx;
+      sigma2 = approx_sigma2;
+    }
+
+    // Store output
+    assign_pos_of(dwi).to(out);
+    for (auto l = Loop (3) (out); l; ++l)
+      out.value() = centre[out.index(3)];
+
+    // store noise map if requested:
+    if (noise.valid()) {
+      assign_pos_of(dwi).to(noise);
+      noise.value() = value_type (std::sqrt(sigma2));
+    }
+  }
+  
+  
+  // Full eigendecomposition: rather than computing all eigenvectors, reduce
+  // XtX to tridiagonal form and compute its eigenvalues, recording the
+  // rotations that would otherwise be accumulated into the eigenvectors
+  // (matrix scaled to [-1:1] as in Eigen::SelfAdjointEigenSolver):
+  void exact_projection ()
+  {
+    double scale = XtX.template triangularView<Eigen::Lower>().toDenseMatrix().cwiseAbs().maxCoeff();
+    if (scale == 0.0)
+      scale = 1.0;
+    XtX.template triangularView<Eigen::Lower>() /= scale;
+    tri.compute (XtX);
+    d = tri.diagonal();
+    e = tri.subDiagonal();
+    if (!tridiagonal_eigenvalues())
+      ++num_unconverged;
+    std::iota (order.begin(), order.end(), 0);
+    std::sort (order.begin(), order.end(), [&] (ssize_t a, ssize_t b) { return d[a] < d[b]; });
     // eigenvalues provide squared singular values:
-    Eigen::VectorXf s = eig.eigenvalues();
+    for (ssize_t p = 0; p < r; ++p)
+      s[p] = scale * d[order[p]];
    
     // Marchenko-Pastur optimal threshold
     const double lam_r = s[0] / n;
@@ -142,29 +273,102 @@ class DenoisingFunctor { MEMALIGN(DenoisingFunctor)
       } 
     }
 
+    if (m > n)
+      centre = X.col (n/2);
     if (cutoff_p > 0) {
       // recombine data using only eigenvectors above threshold:
-      s.head (cutoff_p).setZero();
-      s.tail (r-cutoff_p).setOnes();
-      if (m <= n) 
-        X.col (n/2) = eig.eigenvectors() * ( s.asDiagonal() * ( eig.eigenvectors().adjoint() * X.col(n/2) ));
-      else 
-        X.col (n/2) = X * ( eig.eigenvectors() * ( s.asDiagonal() * eig.eigenvectors().adjoint().col(n/2) ));
+      if (m <= n)
+        w = tri.matrixQ().adjoint() * centre.template cast<double>();
+      else
+        w = tri.matrixQ().adjoint() * Eigen::VectorXd::Unit (r, n/2);
+      for (const auto& rot : rotations)
+        rot.apply_transpose (w);
+      for (ssize_t p = 0; p < cutoff_p; ++p)
+        w[order[p]] = 0.0;
+      for (auto rot = rotations.rbegin(); rot != rotations.rend(); ++rot)
+        rot->apply (w);
+      if (m <= n)
+        centre = Eigen::VectorXd (tri.matrixQ() * w).template cast<float>();
+      else
+        centre = X * Eigen::VectorXd (tri.matrixQ() * w).template cast<float>();
     }
+  }
 
-    // Store output
-    assign_pos_of(dwi).to(out);
-    for (auto l = Loop (3) (out); l; ++l)
-      out.value() = X(out.index(3), n/2);
 
-    // store noise map if requested:
-    if (noise.valid()) {
-      assign_pos_of(dwi).to(noise);
-      noise.value() = value_type (std::sqrt(sigma2));
+  // Approximate decomposition for large matrices, using a Lanczos
+  // decomposition of the Gram matrix started from the vector to be projected.
+  // Only the largest components need to be resolved: the sum of all
+  // eigenvalues below a candidate threshold follows from the trace, and the
+  // smallest eigenvalue is approximated by the smallest Ritz value. Returns
+  // false if the components above the threshold are not all resolved.
+  bool approximate_projection ()
+  {
+    if (m <= n)
+      v = centre.template cast<double>();
+    else
+      v = Eigen::VectorXd::Unit (r, n/2);
+    const double start_norm = v.norm();
+    if (start_norm == 0.0)
+      return false;
+
+    const ssize_t max_steps = std::min (r, std::max (ssize_t (DENOISE_LANCZOS_MIN_STEPS), r / DENOISE_LANCZOS_STEP_RATIO));
+    lanczos.resize (r, max_steps);
+    alpha.resize (max_steps);
+    beta.resize (max_steps);
+    lanczos.col(0) = v / start_norm;
+    ssize_t steps = 0;
+    while (steps < max_steps) {
+      v.noalias() = gram.template selfadjointView<Eigen::Lower>() * lanczos.col (steps);
+      alpha[steps] = lanczos.col (steps).dot (v);
+      // full reorthogonalisation:
+      for (size_t pass = 0; pass < 2; ++pass)
+        v.noalias() -= lanczos.leftCols (steps+1) * (lanczos.leftCols (steps+1).transpose() * v);
+      beta[steps] = v.norm();
+      if (++steps < max_steps) {
+        // invariant subspace: not all eigenvalues are accessible from this start vector
+        if (beta[steps-1] <= std::numeric_limits<double>::epsilon() * std::abs (alpha[steps-1]))
+          return false;
+        lanczos.col (steps) = v / beta[steps-1];
+      }
+    }
+
+    // (scaled to [-1:1] as in Eigen::SelfAdjointEigenSolver::compute())
+    double scale = std::max (alpha.head (steps).cwiseAbs().maxCoeff(), beta.head (steps).cwiseAbs().maxCoeff());
+    if (scale == 0.0)
+      scale = 1.0;
+    ritz.computeFromTridiagonal (alpha.head (steps) / scale, beta.head (steps-1) / scale);
+    const Eigen::VectorXd theta = scale * ritz.eigenvalues();
+    const Eigen::MatrixXd& S (ritz.eigenvectors());
+
+    // Marchenko-Pastur threshold, from the largest converged Ritz values down:
+    const double tolerance = DENOISE_LANCZOS_TOLERANCE * std::abs (theta[steps-1]);
+    const double lam_r = theta[0] / n;
+    double clam = gram.trace() / n;
+    for (ssize_t i = 0; i < steps; ++i) {
+      // residual of Ritz pair:
+      if (std::abs (beta[steps-1] * S(steps-1, steps-1-i)) > tolerance)
+        return false;
+      const ssize_t p = r-1-i;
+      const double lam = theta[steps-1-i] / n;
+      const double gam = double(m-r+p+1) / double(n);
+      const double sigsq1 = clam / (p+1) / std::max (gam, 1.0);
+      const double sigsq2 = (lam - lam_r) / 4 / std::sqrt(gam);
+      if (sigsq2 < sigsq1) {
+        sigma2 = sigsq1;
+        // recombine data using only the Ritz vectors above threshold:
+        v = start_norm * (lanczos.leftCols (steps) * (S.rightCols (i) * S.row(0).tail (i).transpose()));
+        if (m <= n)
+          centre = v.template cast<float>();
+        else
+          centre = X * v.template cast<float>();
+        return true;
+      }
+      clam -= lam;
     }
+    return false;
   }
-  
-  
+
+
   void load_data (ImageType& dwi)
   {
     pos[0] = dwi.index(0); pos[1] = dwi.index(1); pos[2] = dwi.index(2);
@@ -180,15 +384,178 @@ class DenoisingFunctor { MEMALIGN(DenoisingFunctor)
     dwi.index(1) = pos[1];
     dwi.index(2) = pos[2];
   }
-  
+
+
+  // The threaded loop visits consecutive voxels along its innermost axis, so
+  // successive windows typically differ by a single slab of voxels: rather than
+  // reloading the whole patch, remove the slab leaving the window from the
+  // (double precision) Gram matrix, and add the slab entering it.
+  void update_gram (ImageType& dwi)
+  {
+    ssize_t axis = -1;
+    if (gram_valid) {
+      for (size_t a = 0; a < 3; ++a) {
+        if (dwi.index(a) != pos[a]) {
+          if (axis >= 0 || dwi.index(a) != pos[a]+1) {
+            axis = -1;
+            break;
+          }
+          axis = a;
+        }
+      }
+    }
+
+    if (axis < 0) {
+      load_data (dwi);
+      gram.setZero (m, m);
+      gram.template selfadjointView<Eigen::Lower>().rankUpdate (X.template cast<double>());
+    }
+    else {
+      load_slab (dwi, axis, pos[axis]-extent[axis]);
+      gram.template selfadjointView<Eigen::Lower>().rankUpdate (slab.template cast<double>(), -1.0);
+      ++pos[axis];
+      load_slab (dwi, axis, pos[axis]+extent[axis]);
+      gram.template selfadjointView<Eigen::Lower>().rankUpdate (slab.template cast<double>(), 1.0);
+      X.col (n/2) = dwi.row(3);
+    }
+    gram_valid = true;
+  }
+
+
+  void load_slab (ImageType& dwi, const size_t axis, const ssize_t index)
+  {
+    const size_t a1 = axis ? 0 : 1;
+    const size_t a2 = axis == 2 ? 1 : 2;
+    slab.resize (m, (2*extent[a1]+1) * (2*extent[a2]+1));
+    slab.setZero();
+    if (index >= 0 && index < dwi.size (axis)) {
+      dwi.index(axis) = index;
+      ssize_t k = 0;
+      for (dwi.index(a2) = pos[a2]-extent[a2]; dwi.index(a2) <= pos[a2]+extent[a2]; ++dwi.index(a2))
+        for (dwi.index(a1) = pos[a1]-extent[a1]; dwi.index(a1) <= pos[a1]+extent[a1]; ++dwi.index(a1), ++k)
+          if (! is_out_of_bounds(dwi,0,3))
+            slab.col(k) = dwi.row(3);
+    }
+    // reset image position
+    dwi.index(0) = pos[0];
+    dwi.index(1) = pos[1];
+    dwi.index(2) = pos[2];
+  }
+
+
+  // eigenvalues of the tridiagonal matrix (d,e), using implicit symmetric QR
+  // steps with Wilkinson shift as in Eigen::SelfAdjointEigenSolver. Returns
+  // false if the iteration limit is reached before all off-diagonal elements
+  // have vanished (as flagged by Eigen::NoConvergence):
+  bool tridiagonal_eigenvalues ()
+  {
+    rotations.clear();
+    const double considerAsZero = std::numeric_limits<double>::min();
+    const double precision_inv = 1.0 / std::numeric_limits<double>::epsilon();
+    ssize_t end = r-1, start = 0, iter = 0;
+    while (end > 0) {
+      for (ssize_t i = start; i < end; ++i) {
+        if (std::abs (e[i]) < considerAsZero)
+          e[i] = 0.0;
+        else {
+          const double scaled_subdiag = precision_inv * e[i];
+          if (scaled_subdiag * scaled_subdiag <= std::abs (d[i]) + std::abs (d[i+1]))
+            e[i] = 0.0;
+        }
+      }
+      // find the largest unreduced block at the end of the matrix:
+      while (end > 0 && e[end-1] == 0.0)
+        --end;
+      if (end <= 0)
+        return true;
+      if (++iter > DENOISE_MAX_QR_ITERATIONS * r)
+        return false;
+      start = end-1;
+      while (start > 0 && e[start-1] != 0.0)
+        --start;
+      qr_step (start, end);
+    }
+    return true;
+  }
+
+
+  void qr_step (const ssize_t start, const ssize_t end)
+  {
+    // Wilkinson shift:
+    const double td = 0.5 * (d[end-1] - d[end]);
+    const double e_end = e[end-1];
+    double mu = d[end];
+    if (td == 0.0)
+      mu -= std::abs (e_end);
+    else if (e_end != 0.0) {
+      const double h = std::hypot (td, e_end);
+      if (e_end * e_end == 0.0)
+        mu -= e_end / ((td + (td > 0.0 ? h : -h)) / e_end);
+      else
+        mu -= e_end * e_end / (td + (td > 0.0 ? h : -h));
+    }
+
+    double x = d[start] - mu;
+    double z = e[start];
+    for (ssize_t k = start; k < end && z != 0.0; ++k) {
+      Eigen::JacobiRotation<double> rot;
+      rot.makeGivens (x, z);
+      const double c = rot.c(), s = rot.s();
+      // T = G^T T G:
+      const double sdk = s * d[k] + c * e[k];
+      const double dkp1 = s * e[k] + c * d[k+1];
+      d[k] = c * (c * d[k] - s * e[k]) - s * (c * e[k] - s * d[k+1]);
+      d[k+1] = s * sdk + c * dkp1;
+      e[k] = c * sdk - s * dkp1;
+      if (k > start)
+        e[k-1] = c * e[k-1] - s * z;
+      // chase the bulge:
+      x = e[k];
+      if (k < end-1) {
+        z = -s * e[k+1];
+        e[k+1] = c * e[k+1];
+      }
+      rotations.push_back ({ k, c, s });
+    }
+  }
+
+
+  // Givens rotation G, such that the eigenvectors of the tridiagonal matrix
+  // are given by the product of all rotations in the order recorded:
+  class Rotation { NOMEMALIGN
+    public:
+      void apply (Eigen::VectorXd& v) const {
+        const double a = v[k], b = v[k+1];
+        v[k] = c*a + s*b;
+        v[k+1] = c*b - s*a;
+      }
+      void apply_transpose (Eigen::VectorXd& v) const {
+        const double a = v[k], b = v[k+1];
+        v[k] = c*a - s*b;
+        v[k+1] = c*b + s*a;
+      }
+      ssize_t k;
+      double c, s;
+  };
+
 private:
   const std::array<ssize_t, 3> extent;
   const ssize_t m, n, r;
-  Eigen::MatrixXf X;
+  Eigen::MatrixXf X, slab;
+  Eigen::MatrixXd XtX, gram, lanczos;
+  Eigen::VectorXf centre;
+  Eigen::VectorXd s, d, e, w, v, alpha, beta;
+  Eigen::Tridiagonalization<Eigen::MatrixXd> tri;
+  vector<ssize_t> order;
+  vector<Rotation> rotations;
+  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> ritz;
   std::array<ssize_t, 3> pos;
+  bool gram_valid, approximate;
+  size_t num_approximated;
   double sigma2;
   Image<bool> mask;
   ImageType noise;
+  std::shared_ptr<ApproximationStats> stats;
   
 };
 
@@ -232,9 +599,22 @@ void run ()
     noise = Image<value_type>::create (opt[0][0], header);
   }
 
-  DenoisingFunctor< Image<value_type> > func (dwi_in, extent, mask, noise);
+  const int eigensolver = get_option_value ("eigensolver", 0);
+  std::shared_ptr<ApproximationStats> stats;
+  if (eigensolver == 1) {
+    INFO ("using approximate eigensolver");
+    stats = std::make_shared<ApproximationStats>();
+  }
+
+  DenoisingFunctor< Image<value_type> > func (dwi_in, extent, mask, noise, stats);
   ThreadedLoop ("running MP-PCA denoising", dwi_in, 0, 3)
     .run (func, dwi_in, dwi_out);
+
+  if (stats)
+    stats->report();
+  if (num_unconverged)
+    WARN ("eigenvalue decomposition failed to converge in " + str(num_unconverged.load()) + " voxels; "
+          "output may be inaccurate in these voxels");
 }
 
 
@@ -119,6 +119,7 @@ class Segmented_FOD_receiver { MEMALIGN(Segmented_FOD_receiver)
     void set_disp_output (const std::string& path) { disp_path = path; }
 
     bool operator() (const FOD_lobes&);
+    bool operator() (const vector<FOD_lobes>&);
 
 
   private:
@@ -171,6 +172,15 @@ bool Segmented_FOD_receiver::operator() (const FOD_lobes& in)
 
 
 
+bool Segmented_FOD_receiver::operator() (const vector<FOD_lobes>& in)
+{
+  for (const auto& i : in)
+    (*this) (i);
+  return true;
+}
+
+
+
 void Segmented_FOD_receiver::commit ()
 {
   if (!lobes.size() || !fixel_count)
@@ -330,7 +340,7 @@ void run ()
   Segmenter fmls (dirs, Math::SH::LforN (H.size(3)));
   load_fmls_thresholds (fmls);
 
-  Thread::run_queue (writer, Thread::batch (SH_coefs()), Thread::multi (fmls), Thread::batch (FOD_lobes()), receiver);
+  Thread::run_queue (writer, vector<SH_coefs>(), Thread::multi (fmls), vector<FOD_lobes>(), receiver);
   receiver.commit ();
 }
 
@@ -94,8 +94,11 @@ class ComputeSlice
       maxW (maxW),
       in (in),
       out (out),
-      im1 (in.size(slice_axes[0]), in.size(slice_axes[1])),
-      im2 (im1.rows(), im1.cols()) {
+      slice (in.size(slice_axes[0]), in.size(slice_axes[1])),
+      im1 (slice.rows(), slice.cols()),
+      im2 (im1.rows(), im1.cols()),
+      ramps_rows (shift_ramps (im1.rows())),
+      ramps_cols (shift_ramps (im1.cols())) {
         prealloc_FFT();
       }
 
@@ -108,8 +111,11 @@ class ComputeSlice
       in (other.in),
       out (other.out),
       fft (),
-      im1 (in.size(slice_axes[0]), in.size(slice_axes[1])),
-      im2 (im1.rows(), im1.cols()) {
+      slice (in.size(slice_axes[0]), in.size(slice_axes[1])),
+      im1 (slice.rows(), slice.cols()),
+      im2 (im1.rows(), im1.cols()),
+      ramps_rows (shift_ramps (im1.rows())),
+      ramps_cols (shift_ramps (im1.cols())) {
         prealloc_FFT();
       }
 
@@ -121,7 +127,7 @@ class ComputeSlice
       assign_pos_of (pos, outer_axes).to (in, out);
 
       for (auto l = Loop (slice_axes) (in); l; ++l)
-        im1 (in.index(X), in.index(Y)) = cdouble (in.value(), 0.0);
+        slice (in.index(X), in.index(Y)) = in.value();
 
       unring_2d ();
 
@@ -135,14 +141,23 @@ class ComputeSlice
     const int nsh, minW, maxW;
     Image<value_type> in, out;
     Eigen::FFT<double> fft;
+    Eigen::MatrixXd slice, shifted_re, shifted_im;
     Eigen::MatrixXcd im1, im2, shifted;
-    Eigen::VectorXcd v;
+    // phase ramps applying each of the subvoxel shifts to a line of the
+    // given length, computed once and reused for every line & slice:
+    const Eigen::MatrixXcd ramps_rows, ramps_cols;
+    Eigen::VectorXcd v, line;
+    Eigen::VectorXd r;
+    Eigen::MatrixXd diff;
+    Eigen::ArrayXd TV1, TV2;
 
     void prealloc_FFT () {
       // needed to avoid within-thread allocations,
       // which aren't thread-safe in FFTW:
 #ifdef EIGEN_FFTW_DEFAULT
       Eigen::VectorXcd tmp (im1.rows());
+      r = slice.col(0);
+      fft.fwd (tmp, r);
       FFT (tmp);
       iFFT (tmp);
       tmp.resize (im1.cols());
@@ -162,10 +177,37 @@ class ComputeSlice
 
 
 
+    int shift (int j) const { return j <= nsh ? j : nsh - j; }
+
+    Eigen::MatrixXcd shift_ramps (const int n) const
+    {
+      Eigen::MatrixXcd ramps (Eigen::MatrixXcd::Ones (n, 2*nsh+1));
+      const int maxn = (n&1) ? (n-1)/2 : n/2-1;
+      for (int j = 1; j < 2*nsh+1; j++) {
+        const double phi = Math::pi*double(shift(j))/double(n*nsh);
+        if (!(n&1))
+          ramps(n/2,j) = cdouble(0.0, 0.0);
+        for (int l = 0; l < maxn; l++) {
+          const cdouble e (std::cos (phi*(l+1)), std::sin (phi*(l+1)));
+          ramps(l+1,j) = e;
+          ramps(n-1-l,j) = std::conj (e);
+        }
+      }
+      return ramps;
+    }
+
+
+
     FORCE_INLINE void unring_2d ()
     {
+      // input is real: transform columns using the real-input FFT,
+      // then the resulting rows:
+      for (auto n = 0; n < slice.cols(); ++n) {
+        r = slice.col(n);
+        fft.fwd (v, r);
+        im1.col(n) = v;
+      }
       row_FFT (im1);
-      col_FFT (im1);
 
       for (int k = 0; k < im1.cols(); k++) {
         double ck = (1.0+cos(2.0*Math::pi*(double(k)/im1.cols())))*0.5;
@@ -194,96 +236,74 @@ class ComputeSlice
 
 
 
+    // Each line holds the spectrum of a real signal, since the filters
+    // applied in unring_2d() preserve Hermitian symmetry. This allows lines
+    // to be processed in pairs, as the real & imaginary parts of a single
+    // complex signal, halving the number of transforms required for the
+    // subvoxel-shift search.
     template <typename Derived>
       FORCE_INLINE void unring_1d (Eigen::MatrixBase<Derived>&& eig)
       {
         const int n = eig.rows();
         const int numlines = eig.cols();
-        shifted.resize (n, 2*nsh+1);
-
-        int shifts [2*nsh+1];
-        shifts[0] = 0;
-        for (int j = 0; j < nsh; j++) {
-          shifts[j+1] = j+1;
-          shifts[1+nsh+j] = -(j+1);
-        }
-
-        double TV1arr[2*nsh+1];
-        double TV2arr[2*nsh+1];
+        const Eigen::MatrixXcd& ramps = n == im1.rows() ? ramps_rows : ramps_cols;
 
-        for (int k = 0; k < numlines; k++) {
-          shifted.col(0) = eig.col(k);
+        for (int k = 0; k < numlines; k += 2) {
+          line = eig.col(k);
+          if (k+1 < numlines)
+            line += cdouble (0.0, 1.0) * eig.col(k+1);
 
-          const int maxn = (n&1) ? (n-1)/2 : n/2-1;
+          shifted = ramps.array().colwise() * line.array();
+          col_iFFT (shifted);
 
-          for (int j = 1; j < 2*nsh+1; j++) {
-            double phi = Math::pi*double(shifts[j])/double(n*nsh);
-            cdouble u (std::cos(phi), std::sin(phi));
-            cdouble e (1.0, 0.0);
-            shifted(0,j) = shifted(0,0);
+          shifted_re = shifted.real();
+          unring_line (eig.col(k), shifted_re);
+          if (k+1 < numlines) {
+            shifted_im = shifted.imag();
+            unring_line (eig.col(k+1), shifted_im);
+          }
+        }
+      }
 
-            if (!(n&1))
-              shifted(n/2,j) = cdouble(0.0, 0.0);
 
-            for (int l = 0; l < maxn; l++) {
-              e = u*e;
-              int L = l+1; shifted(L,j) = e * shifted(L,0);
-              L = n-1-l;   shifted(L,j) = std::conj(e) * shifted(L,0);
-            }
-          }
+    // find the subvoxel shift minimising the local total variation for each
+    // voxel of the line, given the line at each shift as the columns of
+    // shifted, and interpolate the output accordingly. The total variation
+    // is evaluated for all shifts at once, from the absolute differences
+    // between neighbouring voxels at each shift, computed once per line:
+    template <typename LineType>
+      FORCE_INLINE void unring_line (LineType&& eig, const Eigen::MatrixXd& shifted)
+      {
+        const int n = shifted.rows();
+
+        // diff.col(l): |shifted(l) - shifted(l-1)| for each shift:
+        diff.resize (2*nsh+1, n);
+        for (int l = 0; l < n; ++l)
+          diff.col(l) = (shifted.row(l) - shifted.row((l-1+n)%n)).transpose().cwiseAbs();
+
+        TV1.setZero (2*nsh+1);
+        TV2.setZero (2*nsh+1);
+        for (int t = minW; t <= maxW; t++) {
+          TV1 += diff.col((n-t)%n).array();
+          TV2 += diff.col((t+1)%n).array();
+        }
 
+        for (int l = 0; l < n; ++l) {
+          int minidx;
+          TV1.min (TV2).minCoeff (&minidx);
 
-          col_iFFT (shifted);
+          TV1 += diff.col((l-minW+1+n)%n).array() - diff.col((l-maxW+n)%n).array();
+          TV2 += diff.col((l+maxW+2+n)%n).array() - diff.col((l+minW+1+n)%n).array();
 
-          for (int j = 0; j < 2*nsh+1; ++j) {
-            TV1arr[j] = 0.0;
-            TV2arr[j] = 0.0;
-            for (int t = minW; t <= maxW; t++) {
-              TV1arr[j] += abs (shifted((n-t)%n,j).real() - shifted((n-t-1)%n,j).real());
-              TV1arr[j] += abs (shifted((n-t)%n,j).imag() - shifted((n-t-1)%n,j).imag());
-              TV2arr[j] += abs (shifted((n+t)%n,j).real() - shifted((n+t+1)%n,j).real());
-              TV2arr[j] += abs (shifted((n+t)%n,j).imag() - shifted((n+t+1)%n,j).imag());
-            }
-          }
+          double a0 = shifted((l-1+n)%n,minidx);
+          double a1 = shifted(l,minidx);
+          double a2 = shifted((l+1+n)%n,minidx);
+          double s = double(shift(minidx))/(2.0*nsh);
 
-          for (int l = 0; l < n; ++l) {
-            double minTV = std::numeric_limits<double>::max();
-            int minidx = 0;
-            for (int j = 0; j < 2*nsh+1; ++j) {
-
-              if (TV1arr[j] < minTV) {
-                minTV = TV1arr[j];
-                minidx = j;
-              }
-              if (TV2arr[j] < minTV) {
-                minTV = TV2arr[j];
-                minidx = j;
-              }
-
-              TV1arr[j] += abs (shifted((l-minW+1+n)%n,j).real() - shifted((l-(minW  )+n)%n,j).real());
-              TV1arr[j] -= abs (shifted((l-maxW  +n)%n,j).real() - shifted((l-(maxW+1)+n)%n,j).real());
-              TV2arr[j] += abs (shifted((l+maxW+1+n)%n,j).real() - shifted((l+(maxW+2)+n)%n,j).real());
-              TV2arr[j] -= abs (shifted((l+minW  +n)%n,j).real() - shifted((l+(minW+1)+n)%n,j).real());
-
-              TV1arr[j] += abs (shifted((l-minW+1+n)%n,j).imag() - shifted((l-(minW  )+n)%n,j).imag());
-              TV1arr[j] -= abs (shifted((l-maxW  +n)%n,j).imag() - shifted((l-(maxW+1)+n)%n,j).imag());
-              TV2arr[j] += abs (shifted((l+maxW+1+n)%n,j).imag() - shifted((l+(maxW+2)+n)%n,j).imag());
-              TV2arr[j] -= abs (shifted((l+minW  +n)%n,j).imag() - shifted((l+(minW+1)+n)%n,j).imag());
-            }
-
-            double a0r = shifted((l-1+n)%n,minidx).real();
-            double a1r = shifted(l,minidx).real();
-            double a2r = shifted((l+1+n)%n,minidx).real();
-            double a0i = shifted((l-1+n)%n,minidx).imag();
-            double a1i = shifted(l,minidx).imag();
-            double a2i = shifted((l+1+n)%n,minidx).imag();
-            double s = double(shifts[minidx])/(2.0*nsh);
-
-            if (s > 0.0)
-              eig(l,k) = cdouble (a1r*(1.0-s) + a0r*s, a1i*(1.0-s) + a0i*s);
-            else
-              eig(l,k) = cdouble (a1r*(1.0+s) - a2r*s, a1i*(1.0+s) - a2i*s);
-          }
+          if (s > 0.0)
+            eig[l] = cdouble (a1*(1.0-s) + a0*s, 0.0);
+          else
+            eig[l] = cdouble (a1*(1.0+s) - a2*s, 0.0);
         }
       }
 
@@ -98,7 +98,13 @@ const OptionGroup SmoothOption = OptionGroup ("Options for smooth filter")
             "This can be specified either as a single value to be used for all axes, "
             "or as a comma-separated list of the extent for each axis. "
             "The default extent is 2 * ceil(2.5 * stdev / voxel_size) - 1.")
-  + Argument ("voxels").type_sequence_int();
+  + Argument ("voxels").type_sequence_int()
+
+  + Option ("recursive", "use a recursive approximation to the Gaussian kernel, "
+            "whose computational cost does not depend on the standard deviation. "
+            "This is considerably faster for large kernels, at the expense of a small "
+            "approximation error. It is not applied along axes for which the kernel "
+            "extent has been set explicitly.");
 
 
 
@@ -231,6 +237,7 @@ void run () {
       opt = get_options ("extent");
       if (opt.size())
         filter.set_extent (parse_ints (opt[0][0]));
+      filter.set_recursive (get_options ("recursive").size());
       filter.set_message (std::string("applying ") + std::string(argument[1]) + " filter to image " + std::string(argument[0]));
       Stride::set_from_command_line (filter);
 
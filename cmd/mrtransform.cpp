@@ -161,6 +161,14 @@ void usage ()
         "Use -from 1 to warp from image1 or -from 2 to warp from image2")
     +   Argument ("image").type_integer (1,2)
 
+    + Option ("tile",
+        "apply the non-linear transformation one cubic tile of the output image at a time, with the tile size "
+        "provided in voxels. Only the region of the input image referenced by the current tile is loaded into memory, "
+        "and the input, warp and output images are accessed via memory-mapping where the image format permits, "
+        "allowing images larger than the available RAM to be warped. Applies only to the -warp option, "
+        "and cannot be combined with -warp_full or with a linear transformation.")
+    +   Argument ("size").type_integer (1)
+
     + OptionGroup ("Fibre orientation distribution handling options")
 
     + Option ("modulate",
@@ -189,7 +197,28 @@ void usage ()
 }
 
 void apply_warp (Image<float>& input, Image<float>& output, Image<default_type>& warp,
-  const int interp, const float out_of_bounds_value, const vector<int>& oversample) {
+  const int interp, const float out_of_bounds_value, const vector<int>& oversample, const size_t tile_size) {
+  if (tile_size) {
+    switch (interp) {
+    case 0:
+      Filter::warp_tiled<Interp::Nearest> (input, output, warp, tile_size, out_of_bounds_value, oversample);
+      break;
+    case 1:
+      Filter::warp_tiled<Interp::Linear> (input, output, warp, tile_size, out_of_bounds_value, oversample);
+      break;
+    case 2:
+      Filter::warp_tiled<Interp::Cubic> (input, output, warp, tile_size, out_of_bounds_value, oversample);
+      break;
+    case 3:
+      Filter::warp_tiled<Interp::Sinc> (input, output, warp, tile_size, out_of_bounds_value, oversample);
+      break;
+    default:
+      assert (0);
+      break;
+    }
+    return;
+  }
+
   switch (interp) {
   case 0:
     Filter::warp<Interp::Nearest> (input, output, warp, out_of_bounds_value, oversample);
@@ -266,6 +295,9 @@ void run ()
     add_line (output_header.keyval()["comments"], std::string ("regridded to template image \"" + template_header.name() + "\""));
   }
 
+  // Tiled warping
+  const size_t tile_size = get_option_value ("tile", 0);
+
   // Warp 5D warp
   // TODO add reference to warp format documentation
   opt = get_options ("warp_full");
@@ -292,13 +324,20 @@ void run ()
   if (opt.size()) {
     if (warp.valid())
       throw Exception ("only one warp field can be input with either -warp or -warp_mid");
-    warp = Image<default_type>::open (opt[0][0]).with_direct_io (Stride::contiguous_along_axis(3));
+    warp = Image<default_type>::open (opt[0][0]);
+    if (!tile_size)
+      warp = warp.with_direct_io (Stride::contiguous_along_axis(3));
     if (warp.ndim() != 4)
       throw Exception ("the input -warp file must be a 4D deformation field");
     if (warp.size(3) != 3)
       throw Exception ("the input -warp file must have 3 volumes in the 4th dimension (x,y,z positions)");
   }
 
+  if (tile_size && !warp.valid())
+    throw Exception ("the -tile option applies only to non-linear transformations (-warp)");
+  if (tile_size && warp.ndim() == 5)
+    throw Exception ("the -tile option cannot be used with -warp_full, since the full deformation field is computed in memory");
+
   // Inverse
   const bool inverse = get_options ("inverse").size();
   if (inverse) {
@@ -347,6 +386,9 @@ void run ()
     linear_transform = linear_transform * flip;
   }
 
+  if (tile_size && linear)
+    throw Exception ("the -tile option cannot be used with a linear transformation, since the composed deformation field is computed in memory");
+
   Stride::List stride = Stride::get (input_header);
 
   // Detect FOD image for reorientation
@@ -491,7 +533,10 @@ void run ()
       WARN ("Out of bounds value ignored since the input image will not be regridded");
   }
 
-  auto input = input_header.get_image<float>().with_direct_io (stride);
+  // when tiling, leave the input memory-mapped rather than loading it in full
+  auto input = input_header.get_image<float>();
+  if (!tile_size)
+    input = input.with_direct_io (stride);
 
   // Reslice the image onto template
   if (template_header.valid() && !warp) {
@@ -552,7 +597,9 @@ void run ()
       add_line (output_header.keyval()["comments"], std::string ("resliced using warp image \"" + warp.name() + "\""));
     }
 
-    auto output = Image<float>::create(argument[1], output_header).with_direct_io();
+    auto output = Image<float>::create(argument[1], output_header);
+    if (!tile_size)
+      output = output.with_direct_io();
 
     if (warp.ndim() == 5) {
       Image<default_type> warp_deform;
@@ -564,7 +611,7 @@ void run ()
       } else {
         warp_deform = Registration::Warp::compute_full_deformation (warp, template_header, from);
       }
-      apply_warp (input, output, warp_deform, interp, out_of_bounds_value, oversample);
+      apply_warp (input, output, warp_deform, interp, out_of_bounds_value, oversample, tile_size);
       if (fod_reorientation)
         Registration::Transform::reorient_warp ("reorienting", output, warp_deform, directions_cartesian.transpose(), modulate);
 
@@ -572,13 +619,13 @@ void run ()
     } else if (warp.ndim() == 4 && linear) {
       auto warp_composed = Image<default_type>::scratch (warp);
       Registration::Warp::compose_linear_deformation (linear_transform, warp, warp_composed);
-      apply_warp (input, output, warp_composed, interp, out_of_bounds_value, oversample);
+      apply_warp (input, output, warp_composed, interp, out_of_bounds_value, oversample, tile_size);
       if (fod_reorientation)
         Registration::Transform::reorient_warp ("reorienting", output, warp_composed, directions_cartesian.transpose(), modulate);
 
     // Apply 4D deformation field only
     } else {
-      apply_warp (input, output, warp, interp, out_of_bounds_value, oversample);
+      apply_warp (input, output, warp, interp, out_of_bounds_value, oversample, tile_size);
       if (fod_reorientation)
         Registration::Transform::reorient_warp ("reorienting", output, warp, directions_cartesian.transpose(), modulate);
     }
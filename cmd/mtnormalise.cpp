@@ -18,6 +18,7 @@
 #include "algo/loop.h"
 #include "transform.h"
 #include "math/least_squares.h"
+#include "algo/threaded_loop.h"
 #include "algo/threaded_copy.h"
 #include "adapter/replicate.h"
 
@@ -81,13 +82,14 @@ void usage ()
 template <int poly_order>
 struct PolyBasisFunction { MEMALIGN (PolyBasisFunction)
 
-  const int n_basis_vecs = 20;
+  static constexpr int n_basis_vecs = 20;
+  using vector_type = Eigen::Matrix<double, n_basis_vecs, 1>;
 
-  FORCE_INLINE Eigen::MatrixXd operator () (const Eigen::Vector3& pos) {
+  FORCE_INLINE vector_type operator () (const Eigen::Vector3& pos) const {
     double x = pos[0];
     double y = pos[1];
     double z = pos[2];
-    Eigen::MatrixXd basis(n_basis_vecs, 1);
+    vector_type basis;
     basis(0) = 1.0;
     basis(1) = x;
     basis(2) = y;
@@ -115,11 +117,12 @@ struct PolyBasisFunction { MEMALIGN (PolyBasisFunction)
 
 template <>
 struct PolyBasisFunction<0> { MEMALIGN (PolyBasisFunction<0>)
-  const int n_basis_vecs = 1;
 
-  PolyBasisFunction() {}
-  FORCE_INLINE Eigen::MatrixXd operator () (const Eigen::Vector3&) {
-    Eigen::MatrixXd basis(n_basis_vecs, 1);
+  static constexpr int n_basis_vecs = 1;
+  using vector_type = Eigen::Matrix<double, n_basis_vecs, 1>;
+
+  FORCE_INLINE vector_type operator () (const Eigen::Vector3&) const {
+    vector_type basis;
     basis(0) = 1.0;
     return basis;
   }
@@ -128,13 +131,15 @@ struct PolyBasisFunction<0> { MEMALIGN (PolyBasisFunction<0>)
 
 template <>
 struct PolyBasisFunction<1> { MEMALIGN (PolyBasisFunction<1>)
-  const int n_basis_vecs = 4;
 
-  FORCE_INLINE Eigen::MatrixXd operator () (const Eigen::Vector3& pos) {
+  static constexpr int n_basis_vecs = 4;
+  using vector_type = Eigen::Matrix<double, n_basis_vecs, 1>;
+
+  FORCE_INLINE vector_type operator () (const Eigen::Vector3& pos) const {
     double x = pos[0];
     double y = pos[1];
     double z = pos[2];
-    Eigen::MatrixXd basis(n_basis_vecs, 1);
+    vector_type basis;
     basis(0) = 1.0;
     basis(1) = x;
     basis(2) = y;
@@ -146,13 +151,15 @@ struct PolyBasisFunction<1> { MEMALIGN (PolyBasisFunction<1>)
 
 template <>
 struct PolyBasisFunction<2> { MEMALIGN (PolyBasisFunction<2>)
-  const int n_basis_vecs = 10;
 
-  FORCE_INLINE Eigen::MatrixXd operator () (const Eigen::Vector3& pos) {
+  static constexpr int n_basis_vecs = 10;
+  using vector_type = Eigen::Matrix<double, n_basis_vecs, 1>;
+
+  FORCE_INLINE vector_type operator () (const Eigen::Vector3& pos) const {
     double x = pos[0];
     double y = pos[1];
     double z = pos[2];
-    Eigen::MatrixXd basis(n_basis_vecs, 1);
+    vector_type basis;
     basis(0) = 1.0;
     basis(1) = x;
     basis(2) = y;
@@ -168,20 +175,264 @@ struct PolyBasisFunction<2> { MEMALIGN (PolyBasisFunction<2>)
 };
 
 
-// Removes non-physical voxels from the mask
-FORCE_INLINE void refine_mask (Image<float>& summed,
-  Image<bool>& initial_mask,
-  Image<bool>& refined_mask) {
 
-  for (auto i = Loop (summed, 0, 3) (summed, initial_mask, refined_mask); i; ++i) {
-    if (std::isfinite((float) summed.value ()) && summed.value () > 0.f && initial_mask.value ())
-      refined_mask.value () = true;
-    else
-      refined_mask.value () = false;
-  }
+using ImageType = Image<float>;
+using MaskType = Image<bool>;
+
+
+
+// Normal equations of a linear least-squares problem, accumulated one row
+// at a time. The kernels below each accumulate into their own copy, which is
+// added to the overall system once the kernel is destroyed. Since the voxels
+// handled by each copy, and the order in which the copies are added, depend
+// on the number of threads and on scheduling, results can differ between
+// runs at the level of floating-point rounding.
+class NormalEquations { MEMALIGN (NormalEquations)
+  public:
+    NormalEquations (size_t n) :
+      AtA (Eigen::MatrixXd::Zero (n, n)),
+      Atb (Eigen::VectorXd::Zero (n)) { }
+
+    template <class VectorType>
+    FORCE_INLINE void add (const VectorType& row, double value) {
+      AtA.selfadjointView<Eigen::Lower>().rankUpdate (row);
+      Atb += value * row;
+    }
+
+    NormalEquations& operator+= (const NormalEquations& other) {
+      AtA += other.AtA;
+      Atb += other.Atb;
+      return *this;
+    }
+
+    void reset () {
+      AtA.setZero();
+      Atb.setZero();
+    }
+
+    Eigen::VectorXd solve () const {
+      return AtA.selfadjointView<Eigen::Lower>().ldlt().solve (Atb);
+    }
+
+  private:
+    Eigen::MatrixXd AtA;
+    Eigen::VectorXd Atb;
+};
+
+
+
+// Each row of the tissue balance problem holds the tissue compartments of a
+// voxel, corrected for the current normalisation field; the target is unity
+FORCE_INLINE void add_balance_row (NormalEquations& balance, ImageType& combined_tissue, float norm_field)
+{
+  Eigen::VectorXd x (combined_tissue.size (3));
+  for (auto l = Loop (3) (combined_tissue); l; ++l)
+    x[combined_tissue.index (3)] = combined_tissue.value() / norm_field;
+  balance.add (x, 1.0);
 }
 
 
+
+// Load the tissue compartments into a single (zero-clamped) 4D image, and
+// derive the initial mask from the non-physical voxels of their sum
+class LoadKernel { MEMALIGN (LoadKernel)
+  public:
+    LoadKernel (const vector<Adapter::Replicate<ImageType>>& input_images, size_t& overall_num_voxels) :
+      input_images (input_images),
+      num_voxels (0),
+      overall_num_voxels (overall_num_voxels) { }
+
+    ~LoadKernel () {
+      overall_num_voxels += num_voxels;
+    }
+
+    void operator() (ImageType& combined_tissue, MaskType& orig_mask, MaskType& initial_mask, ImageType& norm_field_image) {
+      float summed = 0.f;
+      for (size_t j = 0; j < input_images.size(); ++j) {
+        assign_pos_of (combined_tissue, 0, 3).to (input_images[j]);
+        const float value = input_images[j].value();
+        summed += value;
+        combined_tissue.index (3) = j;
+        combined_tissue.value() = std::max<float> (value, 0.f);
+      }
+      initial_mask.value() = std::isfinite (summed) && summed > 0.f && orig_mask.value();
+      if (initial_mask.value())
+        ++num_voxels;
+      norm_field_image.value() = 1.f;
+    }
+
+  protected:
+    vector<Adapter::Replicate<ImageType>> input_images;
+    size_t num_voxels;
+    size_t& overall_num_voxels;
+};
+
+
+
+// Compute the log of the balanced, field-corrected sum of tissue
+// compartments within the initial mask, and gather its values
+class SummedLogKernel { MEMALIGN (SummedLogKernel)
+  public:
+    SummedLogKernel (const Eigen::VectorXd& balance_factors, vector<float>& overall_values) :
+      balance_factors (balance_factors),
+      overall_values (overall_values) { }
+
+    ~SummedLogKernel () {
+      overall_values.insert (overall_values.end(), values.begin(), values.end());
+    }
+
+    void operator() (MaskType& initial_mask, ImageType& combined_tissue, ImageType& norm_field_image, ImageType& summed_log) {
+      if (!initial_mask.value())
+        return;
+      double sum = 0.0;
+      for (auto l = Loop (3) (combined_tissue); l; ++l)
+        sum += balance_factors[combined_tissue.index (3)] * combined_tissue.value();
+      summed_log.value() = std::log (sum / norm_field_image.value());
+      values.push_back (summed_log.value());
+    }
+
+  protected:
+    const Eigen::VectorXd& balance_factors;
+    vector<float> values;
+    vector<float>& overall_values;
+};
+
+
+
+// Update the mask by rejecting outliers of the summed log image, keeping
+// track of the number of voxels that changed, and accumulate the tissue
+// balance problem over the updated mask
+class MaskUpdateKernel { MEMALIGN (MaskUpdateKernel)
+  public:
+    MaskUpdateKernel (float lower_threshold, float upper_threshold, NormalEquations* overall_balance,
+        size_t& overall_num_voxels, size_t& overall_num_changed) :
+      lower_threshold (lower_threshold),
+      upper_threshold (upper_threshold),
+      balance (overall_balance ? *overall_balance : NormalEquations (0)),
+      num_voxels (0),
+      num_changed (0),
+      overall_balance (overall_balance),
+      overall_num_voxels (overall_num_voxels),
+      overall_num_changed (overall_num_changed) {
+        balance.reset();
+      }
+
+    ~MaskUpdateKernel () {
+      if (overall_balance)
+        *overall_balance += balance;
+      overall_num_voxels += num_voxels;
+      overall_num_changed += num_changed;
+    }
+
+    void operator() (MaskType& initial_mask, ImageType& summed_log, MaskType& mask, ImageType& combined_tissue, ImageType& norm_field_image) {
+      const bool value = initial_mask.value() &&
+          summed_log.value() >= lower_threshold && summed_log.value() <= upper_threshold;
+      if (value != mask.value()) {
+        mask.value() = value;
+        ++num_changed;
+      }
+      if (value) {
+        ++num_voxels;
+        if (overall_balance)
+          add_balance_row (balance, combined_tissue, norm_field_image.value());
+      }
+    }
+
+  protected:
+    const float lower_threshold, upper_threshold;
+    NormalEquations balance;
+    size_t num_voxels, num_changed;
+    NormalEquations* overall_balance;
+    size_t& overall_num_voxels;
+    size_t& overall_num_changed;
+};
+
+
+
+// Accumulate the fit of the polynomial basis to the log-domain normalisation
+// field over the mask
+template <int poly_order>
+class FieldFitKernel { MEMALIGN (FieldFitKernel<poly_order>)
+  public:
+    FieldFitKernel (const transform_type& basis_transform, const Eigen::VectorXd& balance_factors,
+        float log_norm_value, NormalEquations& overall_field) :
+      basis_transform (basis_transform),
+      balance_factors (balance_factors),
+      log_norm_value (log_norm_value),
+      field (PolyBasisFunction<poly_order>::n_basis_vecs),
+      overall_field (overall_field) { }
+
+    ~FieldFitKernel () {
+      overall_field += field;
+    }
+
+    void operator() (MaskType& mask, ImageType& combined_tissue) {
+      if (!mask.value())
+        return;
+      double sum = 0.0;
+      for (auto l = Loop (3) (combined_tissue); l; ++l)
+        sum += balance_factors[combined_tissue.index (3)] * combined_tissue.value();
+      const Eigen::Vector3 vox (mask.index(0), mask.index(1), mask.index(2));
+      field.add (basis_function (basis_transform * vox), std::log (sum) - log_norm_value);
+    }
+
+  protected:
+    const transform_type& basis_transform;
+    const Eigen::VectorXd& balance_factors;
+    const float log_norm_value;
+    PolyBasisFunction<poly_order> basis_function;
+    NormalEquations field;
+    NormalEquations& overall_field;
+};
+
+
+
+// Generate the normalisation field in the log and image domains, and
+// accumulate both the tissue balance problem for the next iteration and the
+// sum of the log-domain field over the mask
+template <int poly_order>
+class FieldUpdateKernel { MEMALIGN (FieldUpdateKernel<poly_order>)
+  public:
+    FieldUpdateKernel (const transform_type& basis_transform, const Eigen::VectorXd& weights,
+        NormalEquations* overall_balance, double& overall_sum_log_field) :
+      basis_transform (basis_transform),
+      weights (weights),
+      balance (overall_balance ? *overall_balance : NormalEquations (0)),
+      sum_log_field (0.0),
+      overall_balance (overall_balance),
+      overall_sum_log_field (overall_sum_log_field) {
+        balance.reset();
+      }
+
+    ~FieldUpdateKernel () {
+      if (overall_balance)
+        *overall_balance += balance;
+      overall_sum_log_field += sum_log_field;
+    }
+
+    void operator() (ImageType& norm_field_log, ImageType& norm_field_image, MaskType& mask, ImageType& combined_tissue) {
+      const Eigen::Vector3 vox (mask.index(0), mask.index(1), mask.index(2));
+      norm_field_log.value() = basis_function (basis_transform * vox).dot (weights);
+      norm_field_image.value() = std::exp (norm_field_log.value());
+      if (mask.value()) {
+        sum_log_field += norm_field_log.value();
+        if (overall_balance)
+          add_balance_row (balance, combined_tissue, norm_field_image.value());
+      }
+    }
+
+  protected:
+    const transform_type& basis_transform;
+    const typename PolyBasisFunction<poly_order>::vector_type weights;
+    PolyBasisFunction<poly_order> basis_function;
+    NormalEquations balance;
+    double sum_log_field;
+    NormalEquations* overall_balance;
+    double& overall_sum_log_field;
+};
+
+
+
 template <int poly_order> void run_primitive ();
 
 void run ()
@@ -215,11 +466,6 @@ void run ()
 template <int poly_order>
 void run_primitive () {
 
-  PolyBasisFunction<poly_order> basis_function;
-
-  using ImageType = Image<float>;
-  using MaskType = Image<bool>;
-
   vector<Adapter::Replicate<ImageType>> input_images;
   vector<Header> output_headers;
   vector<std::string> output_filenames;
@@ -255,7 +501,6 @@ void run_primitive () {
 
   const size_t n_tissue_types = input_images.size();
 
-  // Load the mask and refine the initial mask to exclude non-positive summed tissue components
   Header header_3D (input_images[0]);
   header_3D.ndim() = 3;
   auto opt = get_options ("mask");
@@ -263,89 +508,75 @@ void run_primitive () {
   auto orig_mask = MaskType::open (opt[0][0]);
   auto initial_mask = MaskType::scratch (orig_mask, "Initial processing mask");
   auto mask = MaskType::scratch (orig_mask, "Processing mask");
-  auto prev_mask = MaskType::scratch (orig_mask, "Previous processing mask");
-
-  {
-    auto summed = ImageType::scratch (header_3D, "Summed tissue volumes");
-    for (size_t j = 0; j < input_images.size(); ++j) {
-      input_progress++;
-
-      for (auto i = Loop (0, 3) (summed, input_images[j]); i; ++i)
-        summed.value() += input_images[j].value();
-    }
-    refine_mask (summed, orig_mask, initial_mask);
-  }
-
-  threaded_copy (initial_mask, mask);
 
-
-  // Load input images into single 4d-image and zero-clamp combined-tissue image
+  // Load input images into single 4d-image and zero-clamp combined-tissue image,
+  // refine the initial mask to exclude non-positive summed tissue components,
+  // and initialise the normalisation field in the image domain
   Header h_combined_tissue (input_images[0]);
   h_combined_tissue.ndim () = 4;
   h_combined_tissue.size (3) = n_tissue_types;
   auto combined_tissue = ImageType::scratch (h_combined_tissue, "Tissue components");
 
-  for (size_t i = 0; i < n_tissue_types; ++i) {
-    input_progress++;
-
-    combined_tissue.index (3) = i;
-    for (auto l = Loop (0, 3) (combined_tissue, input_images[i]); l; ++l) {
-      combined_tissue.value () = std::max<float>(input_images[i].value (), 0.f);
-    }
-  }
+  auto norm_field_image = ImageType::scratch (header_3D, "Normalisation field (intensity)");
+  auto norm_field_log = ImageType::scratch (header_3D, "Normalisation field (log-domain)");
 
   size_t num_voxels = 0;
-  for (auto i = Loop (mask) (mask); i; ++i) {
-    if (mask.value())
-      num_voxels++;
+  {
+    LoadKernel kernel (input_images, num_voxels);
+    ThreadedLoop (combined_tissue, 0, 3).run (kernel, combined_tissue, orig_mask, initial_mask, norm_field_image);
   }
+  input_progress++;
 
   if (!num_voxels)
     throw Exception ("Mask contains no valid voxels.");
 
+  threaded_copy (initial_mask, mask);
+
 
   const float normalisation_value = get_option_value ("value", DEFAULT_NORM_VALUE);
   const float log_norm_value = std::log (normalisation_value);
   const size_t max_iter = get_option_value ("niter", DEFAULT_MAIN_ITER_VALUE);
   const size_t max_balance_iter = DEFAULT_BALANCE_MAXITER_VALUE;
 
-  // Initialise normalisation fields in both image and log domain
-  Eigen::MatrixXd norm_field_weights;
-
-  auto norm_field_image = ImageType::scratch (header_3D, "Normalisation field (intensity)");
-  auto norm_field_log = ImageType::scratch (header_3D, "Normalisation field (log-domain)");
-
-  for (auto i = Loop(norm_field_log) (norm_field_image, norm_field_log); i; ++i) {
-    norm_field_image.value() = 1.f;
-    norm_field_log.value() = 0.f;
+  // The polynomial basis is evaluated over voxel positions normalised to the
+  // extent of the image, which spans the same space of functions as scanner
+  // coordinates but keeps the normal equations of the fit well-conditioned
+  transform_type basis_transform;
+  {
+    Transform transform (mask);
+    Eigen::Vector3 centre, extent;
+    for (size_t axis = 0; axis < 3; ++axis) {
+      centre[axis] = 0.5 * (mask.size (axis) - 1);
+      extent[axis] = mask.size (axis) * mask.spacing (axis);
+    }
+    const default_type scale = 2.0 / extent.maxCoeff();
+    basis_transform.linear() = scale * transform.voxel2scanner.linear();
+    basis_transform.translation() = scale * (transform.voxel2scanner.translation() - transform.voxel2scanner * centre);
   }
 
   Eigen::VectorXd balance_factors (Eigen::VectorXd::Ones (n_tissue_types));
+  NormalEquations balance (n_tissue_types);
+  NormalEquations* balance_ptr = n_tissue_types > 1 ? &balance : nullptr;
+  double sum_log_field = 0.0;
+
+  auto summed_log = ImageType::scratch (header_3D, "Log of summed tissue volumes");
+  vector<float> summed_log_values;
+  summed_log_values.reserve (num_voxels);
 
   size_t iter = 1;
 
   // Store lambda-function for performing outlier-rejection.
   // We perform a coarse outlier-rejection initially as well as
   // a finer outlier-rejection within each iteration of the
-  // tissue (re)balancing loop
+  // tissue (re)balancing loop. This also accumulates the tissue
+  // balance problem over the updated mask, and returns the number
+  // of voxels whose mask status changed.
   auto outlier_rejection = [&](float outlier_range) {
 
-    auto summed_log = ImageType::scratch (header_3D, "Log of summed tissue volumes");
-    for (auto i = Loop (0, 3) (summed_log, combined_tissue, norm_field_image); i; ++i) {
-      for (size_t j = 0; j < n_tissue_types; ++j) {
-        combined_tissue.index(3) = j;
-        summed_log.value() += balance_factors(j) * combined_tissue.value() / norm_field_image.value();
-      }
-      summed_log.value() = std::log(summed_log.value());
-    }
-
-    threaded_copy (initial_mask, mask);
-
-    vector<float> summed_log_values;
-    summed_log_values.reserve (num_voxels);
-    for (auto i = Loop (0, 3) (mask, summed_log); i; ++i) {
-      if (mask.value())
-        summed_log_values.push_back (summed_log.value());
+    summed_log_values.clear();
+    {
+      SummedLogKernel kernel (balance_factors, summed_log_values);
+      ThreadedLoop (initial_mask, 0, 3).run (kernel, initial_mask, combined_tissue, norm_field_image, summed_log);
     }
 
     num_voxels = summed_log_values.size();
@@ -359,17 +590,18 @@ void run_primitive () {
     const float lower_outlier_threshold = lower_quartile - outlier_range * (upper_quartile - lower_quartile);
     const float upper_outlier_threshold = upper_quartile + outlier_range * (upper_quartile - lower_quartile);
 
-    for (auto i = Loop (0, 3) (mask, summed_log); i; ++i) {
-      if (mask.value()) {
-        if (summed_log.value() < lower_outlier_threshold || summed_log.value() > upper_outlier_threshold) {
-          mask.value() = 0;
-          num_voxels--;
-        }
-      }
+    balance.reset();
+    num_voxels = 0;
+    size_t num_changed = 0;
+    {
+      MaskUpdateKernel kernel (lower_outlier_threshold, upper_outlier_threshold, balance_ptr, num_voxels, num_changed);
+      ThreadedLoop (initial_mask, 0, 3).run (kernel, initial_mask, summed_log, mask, combined_tissue, norm_field_image);
     }
 
     if (log_level >= 3)
       display (mask);
+
+    return num_changed;
   };
 
   input_progress.done ();
@@ -378,8 +610,6 @@ void run_primitive () {
   // Perform an initial outlier rejection prior to the first iteration
   outlier_rejection (3.f);
 
-  threaded_copy (mask, prev_mask);
-
   while (iter <= max_iter) {
 
     INFO ("Iteration: " + str(iter));
@@ -394,22 +624,9 @@ void run_primitive () {
 
       if (n_tissue_types > 1) {
 
-        // Solve for tissue balance factors
-        Eigen::MatrixXd X (num_voxels, n_tissue_types);
-        Eigen::VectorXd y (Eigen::VectorXd::Ones (num_voxels));
-        uint32_t index = 0;
-
-        for (auto i = Loop (0, 3) (mask, combined_tissue, norm_field_image); i; ++i) {
-          if (mask.value()) {
-            for (size_t j = 0; j < n_tissue_types; ++j) {
-              combined_tissue.index (3) = j;
-              X (index, j) = combined_tissue.value() / norm_field_image.value();
-            }
-            ++index;
-          }
-        }
-
-        balance_factors = X.colPivHouseholderQr().solve(y);
+        // Solve for tissue balance factors, from the problem accumulated
+        // over the current mask & normalisation field
+        balance_factors = balance.solve();
 
         // Ensure our balance factors satisfy the condition that sum(log(balance_factors)) = 0
         double log_sum = 0.0;
@@ -425,57 +642,30 @@ void run_primitive () {
 
       INFO ("Balance factors (" + str(balance_iter) + "): " + str(balance_factors.transpose()));
 
-      // Perform outlier rejection on log-domain of summed images
-      outlier_rejection(1.5f);
-
-      // Check for convergence
-      balance_converged = true;
-      for (auto i = Loop (0, 3) (mask, prev_mask); i; ++i) {
-        if (mask.value() != prev_mask.value()) {
-          balance_converged = false;
-          break;
-        }
-      }
-
-      threaded_copy (mask, prev_mask);
+      // Perform outlier rejection on log-domain of summed images,
+      // and check for convergence
+      balance_converged = !outlier_rejection (1.5f);
 
       balance_iter++;
     }
 
 
     // Solve for normalisation field weights in the log domain
-    Transform transform (mask);
-    Eigen::MatrixXd norm_field_basis (num_voxels, basis_function.n_basis_vecs);
-    Eigen::VectorXd y (num_voxels);
-    uint32_t index = 0;
-    for (auto i = Loop (0, 3) (mask, combined_tissue); i; ++i) {
-      if (mask.value()) {
-        Eigen::Vector3 vox (mask.index(0), mask.index(1), mask.index(2));
-        Eigen::Vector3 pos = transform.voxel2scanner * vox;
-        norm_field_basis.row (index) = basis_function (pos).col(0);
-
-        double sum = 0.0;
-        for (size_t j = 0; j < n_tissue_types; ++j) {
-          combined_tissue.index(3) = j;
-          sum += balance_factors(j) * combined_tissue.value() ;
-        }
-        y (index++) = std::log(sum) - log_norm_value;
-      }
+    NormalEquations field (PolyBasisFunction<poly_order>::n_basis_vecs);
+    {
+      FieldFitKernel<poly_order> kernel (basis_transform, balance_factors, log_norm_value, field);
+      ThreadedLoop (mask, 0, 3).run (kernel, mask, combined_tissue);
     }
-
-    norm_field_weights = norm_field_basis.colPivHouseholderQr().solve(y);
-
-    // Generate normalisation field in the log domain
-    for (auto i = Loop (0, 3) (norm_field_log); i; ++i) {
-      Eigen::Vector3 vox (norm_field_log.index(0), norm_field_log.index(1), norm_field_log.index(2));
-      Eigen::Vector3 pos = transform.voxel2scanner * vox;
-      norm_field_log.value() = basis_function (pos).col(0).dot (norm_field_weights.col(0));
+    const Eigen::VectorXd norm_field_weights = field.solve();
+
+    // Generate normalisation field in the log & image domains
+    balance.reset();
+    sum_log_field = 0.0;
+    {
+      FieldUpdateKernel<poly_order> kernel (basis_transform, norm_field_weights, balance_ptr, sum_log_field);
+      ThreadedLoop (norm_field_log, 0, 3).run (kernel, norm_field_log, norm_field_image, mask, combined_tissue);
     }
 
-    // Generate normalisation field in the image domain
-    for (auto i = Loop (0, 3) (norm_field_log, norm_field_image); i; ++i)
-      norm_field_image.value () = std::exp(norm_field_log.value());
-
     progress++;
     iter++;
   }
@@ -497,15 +687,10 @@ void run_primitive () {
   }
 
   // Compute log-norm scale parameter (geometric mean of normalisation field in outlier-free mask).
+  // The sum of the log-domain field over the mask was accumulated while generating the field.
   float lognorm_scale (0.f);
-  if (num_voxels) {
-    for (auto i = Loop (0,3) (mask, norm_field_log); i; ++i) {
-      if (mask.value ())
-        lognorm_scale += norm_field_log.value ();
-    }
-
-    lognorm_scale = std::exp(lognorm_scale / (float)num_voxels);
-  }
+  if (num_voxels)
+    lognorm_scale = std::exp (sum_log_field / (double)num_voxels);
 
 
   for (size_t j = 0; j < output_filenames.size(); ++j) {
@@ -513,16 +698,18 @@ void run_primitive () {
 
     output_headers[j].keyval()["lognorm_scale"] = str(lognorm_scale);
     auto output_image = ImageType::create (output_filenames[j], output_headers[j]);
-    const size_t n_vols = input_images[j].size(3);
-    const Eigen::VectorXf zero_vec = Eigen::VectorXf::Zero (n_vols);
 
-    for (auto i = Loop (0,3) (output_image, input_images[j], norm_field_image); i; ++i) {
-      input_images[j].index(3) = 0;
-
-      if (input_images[j].value() < 0.f)
-        output_image.row(3) = zero_vec;
-      else
-        output_image.row(3) = Eigen::VectorXf{input_images[j].row(3)} / norm_field_image.value();
-    }
+    auto& input_image = input_images[j];
+    ThreadedLoop (output_image, 0, 3).run ([] (ImageType& out, Adapter::Replicate<ImageType>& in, ImageType& norm_field) {
+      in.index(3) = 0;
+      if (in.value() < 0.f) {
+        for (auto l = Loop (3) (out); l; ++l)
+          out.value() = 0.f;
+      }
+      else {
+        for (auto l = Loop (3) (out, in); l; ++l)
+          out.value() = in.value() / norm_field.value();
+      }
+    }, output_image, input_image, norm_field_image);
   }
 }
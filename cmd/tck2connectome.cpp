@@ -21,6 +21,7 @@
 #include "types.h"
 
 #include "dwi/tractography/file.h"
+#include "dwi/tractography/file_sharded.h"
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/weights.h"
 #include "dwi/tractography/mapping/loader.h"
@@ -107,7 +108,7 @@ void execute (Image<node_t>& node_image, const node_t max_node_index, const std:
 
   // Prepare for reading the track data
   Tractography::Properties properties;
-  Tractography::Reader<float> reader (argument[0], properties);
+  Tractography::ShardedReader<float> reader (argument[0], properties);
 
   // Initialise classes in preparation for multi-threading
   Mapping::TrackLoader loader (reader, properties["count"].empty() ? 0 : to<size_t>(properties["count"]), "Constructing connectome");
@@ -37,9 +37,14 @@ void usage ()
 
   DESCRIPTION
   + "The program currently supports MRtrix .tck files (input/output), "
+    "MRtrix compressed .tcz files (input/output), "
     "ascii text files (input/output), VTK polydata files (input/output), "
     "and RenderMan RIB (export only)."
 
+  + "Compressed .tcz files store vertex positions quantised onto a regular "
+    "grid (see the -quantisation option); these can be provided as input "
+    "to any command that reads track files."
+
   + "Note that ascii files will be stored with one streamline per numbered file. "
     "To support this, the command will use the multi-file numbering syntax, "
     "where square brackets denote the position of the numbering for the files, "
@@ -74,6 +79,12 @@ void usage ()
       "track point positions from image coordinates (in mm) into real (scanner) coordinates.")
   +    Argument ("reference").type_image_in ()
 
+  + OptionGroup ("Options specific to compressed track file writer")
+
+  + Option ("quantisation", "spacing (in mm) of the grid onto which vertex positions are quantised "
+                            "(default: " + str(TRACK_COMPRESSED_DEFAULT_QUANTISATION) + ")")
+  +   Argument("spacing").type_float(0.0f)
+
   + OptionGroup ("Options specific to PLY writer")
 
   + Option ("sides", "number of sides for streamlines")
@@ -646,7 +657,7 @@ void run ()
     // Reader
     Properties properties;
     std::unique_ptr<ReaderInterface<float> > reader;
-    if (has_suffix(argument[0], ".tck")) {
+    if (has_suffix(argument[0], ".tck") || has_suffix(argument[0], ".tcz")) {
         reader.reset( new Reader<float>(argument[0], properties) );
     }
     else if (has_suffix(argument[0], ".txt")) {
@@ -665,6 +676,10 @@ void run ()
     if (has_suffix(argument[1], ".tck")) {
         writer.reset( new Writer<float>(argument[1], properties) );
     }
+    else if (has_suffix(argument[1], ".tcz")) {
+        auto quantisation = get_options("quantisation").size() ? get_options("quantisation")[0][0].as_float() : TRACK_COMPRESSED_DEFAULT_QUANTISATION;
+        writer.reset( new CompressedWriter<float>(argument[1], properties, quantisation) );
+    }
     else if (has_suffix(argument[1], ".vtk")) {
         writer.reset( new VTKWriter(argument[1]) );
     }
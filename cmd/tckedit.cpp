@@ -56,6 +56,14 @@ void usage ()
     "extracting only a finite number of tracks; "
     "selecting a subset of tracks based on various criteria, for instance regions of interest."
 
+  + "Multiple bundles can be extracted in a single pass through the input data using the -bundles option. "
+    "Each line of the bundle specification file defines one bundle: the path of its output track file, "
+    "followed by any number of whitespace-separated ROI specifications of the form include=spec, "
+    "exclude=spec or mask=spec, where spec is as for the corresponding command-line options. "
+    "Each bundle receives those streamlines that satisfy both the criteria provided on the command line "
+    "and its own ROIs; the tracks_out file then receives those streamlines that satisfy the command-line "
+    "criteria but are not assigned to any bundle. The -number and -skip options apply to each output individually."
+
   + DWI::Tractography::preserve_track_order_desc;
 
   ARGUMENTS
@@ -74,6 +82,10 @@ void usage ()
 
   + Option ("ends_only", "only test the ends of each streamline against the provided include/exclude ROIs")
 
+  + Option ("bundles", "extract multiple bundles in a single pass, as defined in a bundle specification file "
+                       "(see Description)")
+    + Argument ("spec").type_file_in()
+
   // TODO Input weights with multiple input files currently not supported
   + OptionGroup ("Options for handling streamline weights")
   + Tractography::TrackWeightsInOption
@@ -170,6 +182,29 @@ void run ()
   const size_t number = get_option_value ("number", size_t(0));
   const size_t skip   = get_option_value ("skip",   size_t(0));
 
+  auto opt = get_options ("bundles");
+  if (opt.size()) {
+    if (inverse)
+      throw Exception ("Options -inverse and -bundles are mutually exclusive");
+    if (get_options ("tck_weights_out").size())
+      throw Exception ("Options -tck_weights_out and -bundles are mutually exclusive");
+
+    ROISet rois;
+    const auto bundles = load_bundles (opt[0][0], properties, rois);
+
+    Loader loader (input_file_list);
+    BundleWorker worker (properties, bundles, rois, ends_only);
+    BundleReceiver receiver (output_path, properties, bundles, rois, number, skip);
+
+    Thread::run_queue (
+        loader,
+        Thread::batch (Streamline<>()),
+        Thread::multi (worker),
+        Thread::batch (vector<Streamline<>>()),
+        receiver);
+    return;
+  }
+
   Loader loader (input_file_list);
   Worker worker (properties, inverse, ends_only);
   // This needs to be run AFTER creation of the Worker class
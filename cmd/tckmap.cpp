@@ -24,6 +24,7 @@
 
 #include "dwi/gradient.h"
 #include "dwi/tractography/file.h"
+#include "dwi/tractography/file_sharded.h"
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/weights.h"
 
@@ -264,7 +265,7 @@ DataType determine_datatype (const DataType current_dt, const contrast_t contras
 void run () {
 
   Tractography::Properties properties;
-  Tractography::Reader<float> file (argument[0], properties);
+  Tractography::ShardedReader<float> file (argument[0], properties);
 
   const size_t num_tracks = properties["count"].empty() ? 0 : to<size_t> (properties["count"]);
 
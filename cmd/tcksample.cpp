@@ -20,6 +20,7 @@
 #include "thread.h"
 #include "thread_queue.h"
 #include "dwi/tractography/file.h"
+#include "dwi/tractography/file_sharded.h"
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/scalar_file.h"
 #include "dwi/tractography/mapping/mapper.h"
@@ -453,7 +454,7 @@ void execute (DWI::Tractography::Reader<value_type>& reader,
 void run ()
 {
   DWI::Tractography::Properties properties;
-  DWI::Tractography::Reader<value_type> reader (argument[0], properties);
+  DWI::Tractography::ShardedReader<value_type> reader (argument[0], properties);
   auto H = Header::open (argument[1]);
   auto image = H.get_image<value_type>();
 
@@ -475,7 +476,7 @@ void run ()
   if (get_options ("use_tdi_fraction").size()) {
     if (statistic == stat_tck::NONE)
       throw Exception ("Cannot use -use_tdi_fraction option unless a per-streamline statistic is used");
-    DWI::Tractography::Reader<value_type> tdi_reader (argument[0], properties);
+    DWI::Tractography::ShardedReader<value_type> tdi_reader (argument[0], properties);
     DWI::Tractography::Mapping::TrackMapperBase mapper (H);
     mapper.set_use_precise_mapping (interp == interp_type::PRECISE);
     tdi.reset (new TDI (H, num_tracks));
@@ -64,6 +64,12 @@ void usage ()
                                 "numbers of remaining streamlines; provide as comma-separated list of integers")
     + Argument ("counts").type_sequence_int()
 
+  + Option ("incremental", "recalculate the gradient of a candidate streamline during filtering if any of the fixels it traverses "
+                           "have been modified since that gradient was calculated, rather than relying on the gradients of all "
+                           "streamlines calculated at the start of each iteration; this reduces the number of iterations "
+                           "(each of which requires recalculation of all gradients), but the resulting selection of "
+                           "streamlines will differ slightly from that of the default mode")
+
   + SIFTModelProcMaskOption
   + SIFTModelOption
   + SIFTOutputOption
@@ -120,6 +126,7 @@ void run ()
     opt = get_options ("csv");
     if (opt.size())
       sifter.set_csv_path (opt[0][0]);
+    sifter.set_incremental (get_options ("incremental").size());
     opt = get_options ("output_at_counts");
     if (opt.size()) {
       vector<int> counts = parse_ints (opt[0][0]);
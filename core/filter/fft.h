@@ -193,6 +193,183 @@ namespace MR
 
 
 
+    //! the smallest size no less than \a n whose only prime factors are 2, 3 and 5
+    /*! Transforms of such sizes are handled efficiently by the FFT
+     * backend; this is used to decide how much zero-padding to apply. */
+    inline size_t fft_size (size_t n)
+    {
+      if (n <= 1)
+        return 1;
+      for (;; ++n) {
+        size_t m = n;
+        for (size_t f : { 2, 3, 5 })
+          while (!(m % f))
+            m /= f;
+        if (m == 1)
+          return n;
+      }
+    }
+
+
+
+    //! a filter to convolve or correlate an image with a kernel via the FFT
+    /*! The kernel is supplied as a 3D image; its centre voxel (at index
+     * size/2 along each axis) corresponds to zero offset. Its Fourier
+     * transform is computed once on construction, and reused for each
+     * volume of the input image and for each subsequent invocation of the
+     * filter. The first three axes of each volume are zero-padded to a
+     * size suited to the FFT and large enough to avoid wrap-around, so
+     * that the result matches that of a direct spatial convolution with
+     * zero boundary conditions. The transforms are multi-threaded.
+     *
+     * The cost of this filter is essentially independent of the size of
+     * the kernel, which makes it the method of choice for large,
+     * non-separable kernels, or for cross-correlation searches over a
+     * wide range of offsets.
+     *
+     * Typical usage:
+     * \code
+     * auto input = Image<float>::open (argument[0]);
+     * auto kernel = Image<float>::open (argument[1]);
+     * Filter::FFTConvolution convolve (input, kernel);
+     * auto output = Image<float>::create (argument[2], convolve);
+     * convolve (input, output);
+     *
+     * \endcode
+     */
+    class FFTConvolution : public Base { MEMALIGN(FFTConvolution)
+      public:
+
+        //! set \a correlate to compute the cross-correlation with the kernel rather than the convolution
+        template <class HeaderType, class KernelType>
+        FFTConvolution (const HeaderType& in, KernelType& kernel, const bool correlate = false) :
+            Base (in),
+            correlate (correlate)
+        {
+          if (kernel.ndim() > 3)
+            for (size_t axis = 3; axis != kernel.ndim(); ++axis)
+              if (kernel.size (axis) > 1)
+                throw Exception ("kernel image for FFT convolution must be 3D");
+          datatype() = DataType::Float32;
+          datatype().set_byte_order_native();
+
+          Header padded (in);
+          padded.ndim() = 3;
+          for (size_t axis = 0; axis != 3; ++axis)
+            padded.size (axis) = fft_size (in.size (axis) + kernel.size (axis) - 1);
+          padded.datatype() = DataType::CFloat64;
+          kernel_fft = Image<cdouble>::scratch (padded, "FFT of convolution kernel");
+
+          // place the kernel with its centre at the origin, wrapping around
+          // negative offsets, so that the filtered image needs no shifting:
+          for (auto l = Loop (0, 3) (kernel); l; ++l) {
+            for (size_t axis = 0; axis != 3; ++axis) {
+              const ssize_t offset = kernel.index (axis) - kernel.size (axis) / 2;
+              kernel_fft.index (axis) = offset < 0 ? offset + kernel_fft.size (axis) : offset;
+            }
+            kernel_fft.value() = cdouble (kernel.value(), 0.0);
+          }
+          transform (kernel_fft, false);
+        }
+
+
+        template <class InputImageType, class OutputImageType>
+        void operator() (InputImageType& input, OutputImageType& output)
+        {
+          auto data = Image<cdouble>::scratch (kernel_fft, "scratch image for FFT convolution");
+          size_t num_volumes = 1;
+          for (size_t axis = 3; axis < input.ndim(); ++axis)
+            num_volumes *= input.size (axis);
+
+          std::unique_ptr<ProgressBar> progress (message.size() ? new ProgressBar (message, num_volumes) : nullptr);
+          if (input.ndim() > 3) {
+            for (auto v = Loop (3, input.ndim()) (input, output); v; ++v) {
+              filter_volume (input, output, data);
+              if (progress)
+                ++(*progress);
+            }
+          }
+          else
+            filter_volume (input, output, data);
+        }
+
+
+      protected:
+
+        const bool correlate;
+        Image<cdouble> kernel_fft;
+
+        // filter the volume at the current position of the input along axes 3 and up:
+        template <class InputImageType, class OutputImageType>
+        void filter_volume (InputImageType& input, OutputImageType& output, Image<cdouble>& data)
+        {
+          for (auto l = Loop (data) (data); l; ++l)
+            data.value() = cdouble (0.0, 0.0);
+          for (auto l = Loop (0, 3) (input); l; ++l) {
+            assign_pos_of (input, 0, 3).to (data);
+            data.value() = cdouble (input.value(), 0.0);
+          }
+
+          transform (data, false);
+          if (correlate)
+            ThreadedLoop (data).run ([] (Image<cdouble>& d, Image<cdouble>& k) { d.value() = cdouble (d.value()) * std::conj (cdouble (k.value())); }, data, kernel_fft);
+          else
+            ThreadedLoop (data).run ([] (Image<cdouble>& d, Image<cdouble>& k) { d.value() = cdouble (d.value()) * cdouble (k.value()); }, data, kernel_fft);
+          transform (data, true);
+
+          for (auto l = Loop (0, 3) (output); l; ++l) {
+            assign_pos_of (output, 0, 3).to (data);
+            output.value() = typename OutputImageType::value_type (cdouble (data.value()).real());
+          }
+        }
+
+        // in-place 3D FFT, each axis in turn, with lines distributed over threads:
+        static void transform (Image<cdouble>& data, const bool inverse)
+        {
+          for (size_t axis = 0; axis != 3; ++axis) {
+            vector<size_t> axes = Stride::order (data);
+            for (size_t n = 0; n < axes.size(); ++n) {
+              if (axes[n] == axis) {
+                axes.erase (axes.begin() + n);
+                break;
+              }
+            }
+            FFTLineKernel kernel (data, axis, inverse);
+            ThreadedLoop (data, axes, 1).run (kernel, data);
+          }
+        }
+
+        class FFTLineKernel { MEMALIGN(FFTLineKernel)
+          public:
+            FFTLineKernel (const Image<cdouble>& data, const size_t axis, const bool inverse) :
+                data_in (data.size (axis)),
+                data_out (data_in.size()),
+                axis (axis),
+                inverse (inverse) { }
+
+            void operator() (Image<cdouble>& data) {
+              for (data.index(axis) = 0; data.index(axis) < data.size(axis); ++data.index(axis))
+                data_in[data.index(axis)] = data.value();
+              if (inverse)
+                fft.inv (data_out, data_in);
+              else
+                fft.fwd (data_out, data_in);
+              for (data.index(axis) = 0; data.index(axis) < data.size(axis); ++data.index(axis))
+                data.value() = data_out[data.index(axis)];
+              data.index(axis) = 0;
+            }
+
+          protected:
+            Eigen::Matrix<cdouble, Eigen::Dynamic, 1> data_in, data_out;
+            Eigen::FFT<double> fft;
+            const size_t axis;
+            const bool inverse;
+        };
+
+    };
+
+
+
 
   }
 }
@@ -20,8 +20,12 @@
 #include "image.h"
 #include "algo/copy.h"
 #include "algo/threaded_copy.h"
-#include "adapter/gaussian1D.h"
+#include "algo/threaded_loop.h"
 #include "filter/base.h"
+#include "filter/fft.h"
+
+// kernels with at least this many taps are applied via the FFT
+#define SMOOTH_FFT_MIN_KERNEL_SIZE 65
 
 namespace MR
 {
@@ -53,7 +57,8 @@ namespace MR
             extent (3, 0),
             stdev (3, 0.0),
             stride_order (Stride::order (in)),
-            zero_boundary (false)
+            zero_boundary (false),
+            recursive (false)
         {
           for (int i = 0; i < 3; i++)
             stdev[i] = in.spacing(i);
@@ -65,7 +70,9 @@ namespace MR
             Base (in),
             extent (3, 0),
             stdev (3, 0.0),
-            stride_order (Stride::order (in))
+            stride_order (Stride::order (in)),
+            zero_boundary (false),
+            recursive (false)
         {
           set_stdev (stdev_in);
           datatype() = DataType::Float32;
@@ -119,35 +126,25 @@ namespace MR
           }
         }
 
+        //! Use a recursive (IIR) approximation to the Gaussian kernel.
+        //! The recursive filter of Young & van Vliet (1995) has a cost per
+        //! voxel that does not depend on the standard deviation, and is hence
+        //! considerably faster for large kernels. It is only applied along
+        //! axes where the standard deviation is at least half a voxel, and
+        //! where no explicit kernel extent has been set; other axes use the
+        //! direct convolution. (Default: false)
+        void set_recursive (bool use_recursive) {
+          recursive = use_recursive;
+        }
+
         //! Smooth the input image. Both input and output images can be the same image
         template <class InputImageType, class OutputImageType, typename ValueType = float>
         void operator() (InputImageType& input, OutputImageType& output)
         {
-          std::shared_ptr <Image<ValueType> > in (make_shared<Image<ValueType> > (Image<ValueType>::scratch (input)));
-          threaded_copy (input, *in);
-          std::shared_ptr <Image<ValueType> > out;
-
-          std::unique_ptr<ProgressBar> progress;
-          if (message.size()) {
-            size_t axes_to_smooth = 0;
-            for (vector<default_type>::const_iterator i = stdev.begin(); i != stdev.end(); ++i)
-              if (*i)
-                ++axes_to_smooth;
-            progress.reset (new ProgressBar (message, axes_to_smooth + 1));
-          }
-
-          for (size_t dim = 0; dim < 3; dim++) {
-            if (stdev[dim] > 0) {
-              DEBUG ("creating scratch image for smoothing image along dimension " + str(dim));
-              out = make_shared<Image<ValueType> > (Image<ValueType>::scratch (input));
-              Adapter::Gaussian1D<Image<ValueType> > gaussian (*in, stdev[dim], dim, extent[dim], zero_boundary);
-              threaded_copy (gaussian, *out, 0, input.ndim(), 2);
-              in = out;
-              if (progress)
-                ++(*progress);
-            }
-          }
-          threaded_copy (*in, output);
+          auto scratch = Image<ValueType>::scratch (input);
+          threaded_copy (input, scratch);
+          (*this) (scratch);
+          threaded_copy (scratch, output);
         }
 
         //! Smooth the image in place
@@ -165,15 +162,16 @@ namespace MR
 
           for (size_t dim = 0; dim < 3; dim++) {
             if (stdev[dim] > 0) {
-              vector<size_t> axes (in_and_output.ndim(), dim);
-              size_t axdim = 1;
-              for (size_t i = 0; i < in_and_output.ndim(); ++i) {
-                if (stride_order[i] == dim)
-                  continue;
-                axes[axdim++] = stride_order[i];
-              }
-              DEBUG ("smoothing dimension " + str(dim) + " in place with stride order: " + str(axes));
-              SmoothFunctor1D<ImageType> smooth (in_and_output, stdev[dim], dim, extent[dim], zero_boundary);
+              // loop over all axes other than the one being smoothed:
+              // each invocation of the functor processes one complete line
+              vector<size_t> axes;
+              for (size_t i = 0; i < in_and_output.ndim(); ++i)
+                if (stride_order[i] != dim)
+                  axes.push_back (stride_order[i]);
+              SmoothFunctor1D<ImageType> smooth (in_and_output, stdev[dim], dim, extent[dim], zero_boundary, recursive);
+              if (smooth.is_identity())
+                continue;
+              DEBUG ("smoothing dimension " + str(dim) + " in place" + (smooth.is_recursive() ? " using recursive filter" : (smooth.uses_fft() ? " using FFT" : "")) + " with outer axes: " + str(axes));
               ThreadedLoop (in_and_output, axes, 1).run (smooth, in_and_output);
               if (progress)
                 ++(*progress);
@@ -186,7 +184,13 @@ namespace MR
         vector<default_type> stdev;
         const vector<size_t> stride_order;
         bool zero_boundary;
+        bool recursive;
 
+        // SmoothFunctor1D:
+        // filters one complete line of the image along the smoothing axis per
+        // invocation. The line is copied into a contiguous buffer, filtered
+        // into a second buffer, and written back; the inner loops operate on
+        // whole buffer segments so that they vectorise.
         template <class ImageType>
           class SmoothFunctor1D { MEMALIGN (SmoothFunctor1D)
           public:
@@ -194,13 +198,16 @@ namespace MR
                            default_type stdev_in = 1.0,
                            size_t axis_in = 0,
                            size_t extent = 0,
-                           bool zero_boundary_in = false):
+                           bool zero_boundary_in = false,
+                           bool recursive_in = false):
                 stdev (stdev_in),
                 axis (axis_in),
                 zero_boundary (zero_boundary_in),
                 spacing (image.spacing(axis_in)),
-                buffer_size (image.size(axis_in)) {
-                  buffer.resize(buffer_size);
+                buffer_size (image.size(axis_in)),
+                recursive (recursive_in && !extent && stdev_in / image.spacing(axis_in) >= 0.5) {
+                  buffer.resize (buffer_size);
+                  filtered.resize (buffer_size);
                   if (!extent)
                     radius = std::ceil(2 * stdev / spacing);
                   else if (extent == 1)
@@ -208,10 +215,18 @@ namespace MR
                   else
                     radius = (extent - 1) / 2;
                   compute_kernel();
+                  if (recursive)
+                    compute_recursive_coefficients();
+                  else if (kernel.size() >= SMOOTH_FFT_MIN_KERNEL_SIZE)
+                    compute_kernel_fft();
               }
 
             using value_type = typename ImageType::value_type;
 
+            bool is_identity () const { return !kernel.size() && !recursive; }
+            bool is_recursive () const { return recursive; }
+            bool uses_fft () const { return kernel_fft.size(); }
+
             void compute_kernel() {
               if ((radius < 1) || stdev <= 0.0)
                 return;
@@ -226,43 +241,130 @@ namespace MR
               }
             }
 
+            // coefficients of the third-order recursive filter of
+            // Young & van Vliet, Signal Processing 44:139-151 (1995)
+            void compute_recursive_coefficients() {
+              const default_type sigma = stdev / spacing;
+              const default_type q = sigma >= 2.5 ?
+                  0.98711 * sigma - 0.96330 :
+                  3.97156 - 4.14554 * std::sqrt (1.0 - 0.26891 * sigma);
+              const default_type q2 = q*q, q3 = q2*q;
+              const default_type b0 = 1.57825 + 2.44413*q + 1.4281*q2 + 0.422205*q3;
+              b[0] = (2.44413*q + 2.85619*q2 + 1.26661*q3) / b0;
+              b[1] = -(1.4281*q2 + 1.26661*q3) / b0;
+              b[2] = 0.422205*q3 / b0;
+              B = 1.0 - (b[0] + b[1] + b[2]);
+            }
+
+            // zero-padded to avoid wrap-around, with the kernel centred on
+            // the origin so that the filtered line needs no shifting
+            void compute_kernel_fft() {
+              padded.setZero (fft_size (buffer_size + 2*radius));
+              for (ssize_t c = 0; c < kernel.size(); ++c)
+                padded[c < radius ? padded.size() + c - radius : c - radius] = kernel[c];
+              fft.SetFlag (Eigen::FFT<default_type>::HalfSpectrum);
+              fft.fwd (kernel_fft, padded);
+              // the kernel is truncated near the ends of the line, and
+              // renormalised as in the direct convolution:
+              edge_scale.setOnes (buffer_size);
+              for (ssize_t pos = 0; pos < buffer_size; ++pos) {
+                const ssize_t from = (pos < radius) ? 0 : pos - radius;
+                const ssize_t to = (pos + radius) >= buffer_size ? buffer_size - 1 : pos + radius;
+                if (to - from + 1 != kernel.size())
+                  edge_scale[pos] = 1.0 / kernel.segment ((pos < radius) ? radius - pos : 0, to - from + 1).sum();
+              }
+            }
+
             // SmoothFunctor1D operator():
-            // the inner loop axis has to be the dimension the smoothing is applied to and
-            // the loop has to start with image.index (smooth_axis) == 0
+            // the loop must not include the smoothing axis, and the image
+            // must be positioned at index 0 along that axis
             void operator () (ImageType& image) {
-              if (!kernel.size())
-                return;
+              for (ssize_t k = 0; k < buffer_size; ++k) {
+                image.index(axis) = k;
+                buffer[k] = image.value();
+              }
 
-              const ssize_t pos = image.index (axis);
+              if (recursive && buffer.allFinite())
+                filter_recursive();
+              else if (uses_fft() && buffer.allFinite())
+                convolve_fft();
+              else
+                convolve();
 
-              // fill buffer for current image line if necessary
-              if (pos == 0) {
-                for (ssize_t k = 0; k < buffer_size; ++k) {
-                  image.index(axis) = k;
-                  buffer(k) = image.value();
-                }
-                image.index (axis) = pos;
+              if (zero_boundary) {
+                filtered[0] = 0.0;
+                filtered[buffer_size-1] = 0.0;
               }
 
-              if (zero_boundary)
-                if (pos == 0 || pos == image.size(axis) - 1) {
-                  image.value() = 0.0;
-                  return;
-                }
+              for (ssize_t k = 0; k < buffer_size; ++k) {
+                image.index(axis) = k;
+                image.value() = filtered[k];
+              }
+              image.index(axis) = 0;
+            }
 
+          private:
+            const default_type stdev;
+            ssize_t radius;
+            size_t axis;
+            Eigen::VectorXd kernel;
+            const bool zero_boundary;
+            const default_type spacing;
+            ssize_t buffer_size;
+            Eigen::VectorXd buffer, filtered;
+            const bool recursive;
+            default_type b[3], B;
+            Eigen::FFT<default_type> fft;
+            Eigen::VectorXd padded, edge_scale;
+            Eigen::VectorXcd kernel_fft, line_fft;
+
+            void convolve_fft () {
+              padded.head (buffer_size) = buffer;
+              padded.tail (padded.size() - buffer_size).setZero();
+              fft.fwd (line_fft, padded);
+              line_fft.array() *= kernel_fft.array();
+              fft.inv (padded, line_fft, padded.size());
+              filtered = padded.head (buffer_size).cwiseProduct (edge_scale);
+            }
+
+            void convolve () {
+              if (!kernel.size()) {
+                filtered = buffer;
+                return;
+              }
+              // positions whose neighbourhood lies entirely within the line:
+              // accumulate one kernel tap at a time over the whole segment
+              const ssize_t interior = buffer_size - 2*radius;
+              if (interior > 0) {
+                auto out = filtered.segment (radius, interior);
+                out = kernel[0] * buffer.segment (0, interior);
+                for (ssize_t c = 1; c < kernel.size(); ++c)
+                  out += kernel[c] * buffer.segment (c, interior);
+                for (ssize_t pos = radius; pos < buffer_size - radius; ++pos)
+                  if (!std::isfinite (filtered[pos]))
+                    filtered[pos] = convolve (pos);
+              }
+              // positions near the ends of the line, where the kernel is truncated:
+              for (ssize_t pos = 0; pos < std::min (radius, buffer_size); ++pos)
+                filtered[pos] = convolve (pos);
+              for (ssize_t pos = std::max (radius, buffer_size - radius); pos < buffer_size; ++pos)
+                filtered[pos] = convolve (pos);
+            }
+
+            default_type convolve (const ssize_t pos) const {
               const ssize_t from = (pos < radius) ? 0 : pos - radius;
-              const ssize_t to = (pos + radius) >= image.size(axis) ? image.size(axis) - 1 : pos + radius;
+              const ssize_t to = (pos + radius) >= buffer_size ? buffer_size - 1 : pos + radius;
 
               ssize_t c = (pos < radius) ? radius - pos : 0;
               ssize_t kernel_size = to - from + 1;
 
-              value_type result = kernel.segment(c, kernel_size).dot(buffer.segment(from, kernel_size));
+              default_type result = kernel.segment(c, kernel_size).dot(buffer.segment(from, kernel_size));
 
               if (!std::isfinite(result)) {
                 result = 0.0;
-                value_type av_weights = 0.0;
+                default_type av_weights = 0.0;
                 for (ssize_t k = from; k <= to; ++k, ++c) {
-                  value_type neighbour_value = buffer(k);
+                  default_type neighbour_value = buffer[k];
                   if (std::isfinite (neighbour_value)) {
                     av_weights += kernel[c];
                     result += neighbour_value * kernel[c];
@@ -270,19 +372,26 @@ namespace MR
                 }
                 result /= av_weights;
               } else if (kernel_size != kernel.size())
-                  result /= kernel.segment(c, kernel_size).sum();
-              image.value() = result;
+                result /= kernel.segment(c, kernel_size).sum();
+              return result;
             }
 
-          private:
-            const default_type stdev;
-            ssize_t radius;
-            size_t axis;
-            Eigen::VectorXd kernel;
-            const bool zero_boundary;
-            const default_type spacing;
-            ssize_t buffer_size;
-            Eigen::VectorXd buffer;
+            // causal pass followed by anti-causal pass, with the line
+            // extended by replication of its end values
+            void filter_recursive () {
+              default_type w1 = buffer[0], w2 = w1, w3 = w1;
+              for (ssize_t k = 0; k < buffer_size; ++k) {
+                const default_type w = B * buffer[k] + b[0]*w1 + b[1]*w2 + b[2]*w3;
+                filtered[k] = w;
+                w3 = w2; w2 = w1; w1 = w;
+              }
+              w1 = w2 = w3 = filtered[buffer_size-1];
+              for (ssize_t k = buffer_size-1; k >= 0; --k) {
+                const default_type w = B * filtered[k] + b[0]*w1 + b[1]*w2 + b[2]*w3;
+                filtered[k] = w;
+                w3 = w2; w2 = w1; w1 = w;
+              }
+            }
           };
     };
     //! @}
@@ -17,9 +17,12 @@
 #define __filter_warp_h__
 
 #include "datatype.h"
+#include "progressbar.h"
 #include "adapter/reslice.h"
+#include "adapter/subset.h"
 #include "adapter/warp.h"
 #include "algo/threaded_copy.h"
+#include "algo/loop.h"
 #include "algo/threaded_loop.h"
 #include "interp/cubic.h"
 #include "filter/reslice.h"
@@ -98,6 +101,122 @@ namespace MR
         }
       }
 
+    //! convenience function to warp one image onto another, one tile at a time
+    /*! This function produces the same output as Filter::warp(), but processes
+     * the destination in cubic tiles of \a tile_size voxels. For each tile, the
+     * deformation field is extracted (or resliced) onto the tile grid, and the
+     * bounding box of the source voxels it references (padded to allow for the
+     * interpolation kernel) is copied into a scratch image. Only the current
+     * tile's source region, deformation and output then need to be held in
+     * memory, which allows very large images to be warped when \a source,
+     * \a warp and \a destination are backed by memory-mapped files (i.e. not
+     * opened using with_direct_io()). */
+    template <template <class VoxelType> class Interpolator, class ImageTypeDestination, class ImageTypeSource, class WarpType>
+      void warp_tiled (
+          ImageTypeSource& source,
+          ImageTypeDestination& destination,
+          WarpType& warp,
+          const size_t tile_size,
+          const typename ImageTypeDestination::value_type value_when_out_of_bounds = Interpolator<ImageTypeSource>::default_out_of_bounds_value(),
+          vector<int> oversample = Adapter::AutoOverSample)
+      {
+        using source_value_type = typename ImageTypeSource::value_type;
+        using warp_value_type = typename WarpType::value_type;
+
+        if (!tile_size)
+          throw Exception ("tile size for warping must be positive");
+
+        const bool warp_on_destination_grid = warp.transform().matrix() == destination.transform().matrix() &&
+                                              dimensions_match (warp, destination, 0, 3) &&
+                                              spacings_match (warp, destination, 0, 3);
+
+        // interpolation kernels extend at most this far beyond the sampled position:
+        const ssize_t margin = 4;
+
+        const Transform source_transform (source);
+        ssize_t num_tiles[3];
+        for (size_t n = 0; n < 3; ++n)
+          num_tiles[n] = (destination.size(n) + tile_size - 1) / tile_size;
+
+        ProgressBar progress ("warping \"" + source.name() + "\"", num_tiles[0] * num_tiles[1] * num_tiles[2]);
+
+        for (ssize_t tz = 0; tz < num_tiles[2]; ++tz) {
+          for (ssize_t ty = 0; ty < num_tiles[1]; ++ty) {
+            for (ssize_t tx = 0; tx < num_tiles[0]; ++tx, ++progress) {
+
+              vector<ssize_t> from (destination.ndim(), 0), size (destination.ndim());
+              const ssize_t t[3] = { tx, ty, tz };
+              for (size_t n = 0; n < 3; ++n) {
+                from[n] = t[n] * tile_size;
+                size[n] = std::min (ssize_t (tile_size), destination.size(n) - from[n]);
+              }
+              for (size_t n = 3; n < destination.ndim(); ++n)
+                size[n] = destination.size(n);
+
+              Adapter::Subset<ImageTypeDestination> destination_tile (destination, from, size);
+
+              // deformation field over this tile:
+              Header warp_header (destination_tile);
+              warp_header.ndim() = 4;
+              warp_header.size(3) = 3;
+              Stride::set (warp_header, Stride::contiguous_along_axis (3, warp_header));
+              auto warp_tile = Image<warp_value_type>::scratch (warp_header);
+              if (warp_on_destination_grid) {
+                vector<ssize_t> warp_from (from.begin(), from.begin()+3), warp_size (size.begin(), size.begin()+3);
+                warp_from.push_back (0);
+                warp_size.push_back (3);
+                Adapter::Subset<WarpType> warp_subset (warp, warp_from, warp_size);
+                threaded_copy (warp_subset, warp_tile, 0, 4, 2);
+              } else {
+                Adapter::Reslice<Interp::Cubic, WarpType> warp_resliced (warp, warp_tile, Adapter::NoTransform, oversample);
+                threaded_copy (warp_resliced, warp_tile, 0, 4, 2);
+              }
+
+              // bounding box of source voxels referenced by this tile:
+              Eigen::Vector3d lower = Eigen::Vector3d::Constant (std::numeric_limits<default_type>::infinity());
+              Eigen::Vector3d upper = -lower;
+              for (auto l = Loop (warp_tile, 0, 3) (warp_tile); l; ++l) {
+                const Eigen::Vector3d pos = warp_tile.row(3);
+                if (!pos.allFinite())
+                  continue;
+                const Eigen::Vector3d voxel = source_transform.scanner2voxel * pos;
+                lower = lower.cwiseMin (voxel);
+                upper = upper.cwiseMax (voxel);
+              }
+
+              vector<ssize_t> source_from (source.ndim(), 0), source_size (source.ndim());
+              bool empty = !(lower.array() <= upper.array()).all();
+              for (size_t n = 0; n < 3 && !empty; ++n) {
+                const ssize_t first = std::max (ssize_t (0), ssize_t (std::floor (lower[n])) - margin);
+                const ssize_t last = std::min (source.size(n) - 1, ssize_t (std::ceil (upper[n])) + margin);
+                if (last < first)
+                  empty = true;
+                source_from[n] = first;
+                source_size[n] = last - first + 1;
+              }
+              for (size_t n = 3; n < source.ndim(); ++n)
+                source_size[n] = source.size(n);
+
+              if (empty) {
+                for (auto l = Loop (destination_tile) (destination_tile); l; ++l)
+                  destination_tile.value() = value_when_out_of_bounds;
+                continue;
+              }
+
+              Adapter::Subset<ImageTypeSource> source_subset (source, source_from, source_size);
+              auto source_tile = Image<source_value_type>::scratch (Header (source_subset));
+              threaded_copy (source_subset, source_tile, 0, source.ndim(), 2);
+
+              Adapter::Warp<Interpolator, Image<source_value_type>, Image<warp_value_type> > interp (source_tile, warp_tile, value_when_out_of_bounds);
+              if (destination.ndim() == 4)
+                ThreadedLoop (interp, 0, 3, 1).run (CopyKernel4D(), interp, destination_tile);
+              else
+                threaded_copy (interp, destination_tile, 0, destination.ndim(), 2);
+            }
+          }
+        }
+      }
+
     //! @}
   }
 }
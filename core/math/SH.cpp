@@ -15,6 +15,19 @@
 
 #include "math/SH.h"
 
+#include <cstdio>
+#include <fstream>
+#include <list>
+#include <mutex>
+
+#include "file/config.h"
+#include "file/ofstream.h"
+#include "file/path.h"
+#include "file/utils.h"
+
+// maximum number of transforms retained in memory by cached_transform():
+#define SH_TRANSFORM_CACHE_SIZE 4
+
 namespace MR
 {
   namespace Math
@@ -43,6 +56,131 @@ namespace MR
         "etc...\n";
 
 
+
+      //! \cond skip
+      namespace
+      {
+        // 64-bit FNV-1a hash of the direction values, used to name cache files:
+        std::string hash_directions (const Eigen::MatrixXd& dirs)
+        {
+          uint64_t hash = 14695981039346656037ULL;
+          const uint8_t* bytes = reinterpret_cast<const uint8_t*> (dirs.data());
+          for (size_t n = 0; n < dirs.size() * sizeof (double); ++n) {
+            hash ^= bytes[n];
+            hash *= 1099511628211ULL;
+          }
+          std::ostringstream key;
+          key << std::hex << hash;
+          return key.str();
+        }
+
+        // cache files hold the dimensions of the direction set and lmax, then
+        // the direction set itself (so that hash collisions are detected), then
+        // the pseudo-inverse, all as raw native-endian values:
+        bool load_transform (const std::string& path, const Eigen::MatrixXd& dirs, const int lmax, Eigen::MatrixXd& iSHT)
+        {
+          std::ifstream in (path, std::ios::in | std::ios::binary);
+          if (!in)
+            return false;
+          int64_t header[3];
+          in.read (reinterpret_cast<char*> (header), sizeof (header));
+          if (!in || header[0] != dirs.rows() || header[1] != dirs.cols() || header[2] != lmax)
+            return false;
+          Eigen::MatrixXd stored_dirs (dirs.rows(), dirs.cols());
+          in.read (reinterpret_cast<char*> (stored_dirs.data()), stored_dirs.size() * sizeof (double));
+          if (!in || stored_dirs != dirs)
+            return false;
+          iSHT.resize (NforL (lmax), dirs.rows());
+          in.read (reinterpret_cast<char*> (iSHT.data()), iSHT.size() * sizeof (double));
+          return bool (in);
+        }
+
+        // write to a uniquely-named file in the same folder, then rename, so
+        // that concurrent invocations never see a partially written file:
+        void save_transform (const std::string& path, const Eigen::MatrixXd& dirs, const int lmax, const Eigen::MatrixXd& iSHT)
+        {
+          std::string temp_path = path + ".XXXXXX";
+          for (size_t n = path.size()+1; n < temp_path.size(); ++n)
+            temp_path[n] = File::random_char();
+          {
+            File::OFStream out (temp_path, std::ios::out | std::ios::binary);
+            const int64_t header[3] = { dirs.rows(), dirs.cols(), lmax };
+            out.write (reinterpret_cast<const char*> (header), sizeof (header));
+            out.write (reinterpret_cast<const char*> (dirs.data()), dirs.size() * sizeof (double));
+            out.write (reinterpret_cast<const char*> (iSHT.data()), iSHT.size() * sizeof (double));
+            if (!out) {
+              out.close();
+              std::remove (temp_path.c_str());
+              throw Exception ("error writing file \"" + temp_path + "\"");
+            }
+          }
+          if (std::rename (temp_path.c_str(), path.c_str())) {
+            std::remove (temp_path.c_str());
+            throw Exception ("error renaming file \"" + temp_path + "\" to \"" + path + "\": " + strerror (errno));
+          }
+        }
+
+        struct CachedTransform { MEMALIGN(CachedTransform)
+          std::string key;
+          Eigen::MatrixXd dirs, SHT, iSHT;
+        };
+      }
+      //! \endcond
+
+
+
+      void cached_transform (const Eigen::MatrixXd& dirs, const int lmax, Eigen::MatrixXd& SHT, Eigen::MatrixXd& iSHT)
+      {
+        // most recently used first:
+        static std::list<CachedTransform> cache;
+        static std::mutex mutex;
+
+        const std::string key = hash_directions (dirs) + "-" + str(dirs.rows()) + "-" + str(lmax);
+        {
+          std::lock_guard<std::mutex> lock (mutex);
+          for (auto entry = cache.begin(); entry != cache.end(); ++entry) {
+            if (entry->key == key && entry->dirs == dirs) {
+              cache.splice (cache.begin(), cache, entry);
+              SHT = cache.front().SHT;
+              iSHT = cache.front().iSHT;
+              return;
+            }
+          }
+        }
+
+        // computed outside the lock, so that concurrent requests for other
+        // transforms are not held up; a concurrent request for the same
+        // transform may duplicate the work, but yields the same result:
+        SHT = init_transform (dirs, lmax);
+
+        //CONF option: SHTransformCache
+        //CONF default: (none)
+        //CONF A folder in which to store the pseudo-inverse of spherical
+        //CONF harmonic transforms once computed, keyed on the set of
+        //CONF directions and maximum harmonic degree, so that subsequent
+        //CONF invocations using the same directions can skip this setup.
+        //CONF If not set, these matrices are only reused within a single
+        //CONF invocation.
+        const std::string cache_dir = File::Config::get ("SHTransformCache");
+        const std::string cache_file = cache_dir.size() ? Path::join (cache_dir, "shtransform-" + key + ".bin") : std::string();
+        if (cache_file.empty() || !load_transform (cache_file, dirs, lmax, iSHT)) {
+          iSHT = pinv (SHT);
+          if (cache_file.size()) {
+            try {
+              save_transform (cache_file, dirs, lmax, iSHT);
+            } catch (Exception& e) {
+              e.display (2);
+              WARN ("unable to write SH transform to cache folder \"" + cache_dir + "\"");
+            }
+          }
+        }
+
+        std::lock_guard<std::mutex> lock (mutex);
+        cache.push_front ({ key, dirs, SHT, iSHT });
+        if (cache.size() > SH_TRANSFORM_CACHE_SIZE)
+          cache.pop_back();
+      }
+
     }
   }
 }
@@ -76,27 +76,31 @@ namespace MR
       //! form the SH->amplitudes matrix
       /*! This computes the matrix \a SHT mapping spherical harmonic
        * coefficients up to maximum harmonic degree \a lmax onto directions \a
-       * dirs (in spherical coordinates, with columns [ azimuth elevation ]). */
+       * dirs (in spherical coordinates, with columns [ azimuth elevation ]).
+       * The basis is evaluated for all directions at once, one column at a
+       * time. */
       template <class MatrixType>
         Eigen::Matrix<typename MatrixType::Scalar,Eigen::Dynamic, Eigen::Dynamic> init_transform (const MatrixType& dirs, const int lmax)
         {
           using namespace Eigen;
           using value_type = typename MatrixType::Scalar;
+          using array_type = Array<value_type,Dynamic,1>;
           if (dirs.cols() != 2)
             throw Exception ("direction matrix should have 2 columns: [ azimuth elevation ]");
           Matrix<value_type,Dynamic,Dynamic> SHT (dirs.rows(), NforL (lmax));
-          Matrix<value_type,Dynamic,1,0,64> AL (lmax+1);
-          for (ssize_t i = 0; i < dirs.rows(); i++) {
-            const value_type x = std::cos (dirs (i,1));
-            Legendre::Plm_sph (AL, lmax, 0, x);
-            for (int l = 0; l <= lmax; l+=2)
-              SHT (i,index (l,0)) = AL[l];
-            for (int m = 1; m <= lmax; m++) {
-              Legendre::Plm_sph (AL, lmax, m, x);
-              for (int l = ( (m&1) ? m+1 : m); l <= lmax; l+=2) {
-                SHT(i, index(l, m)) = Math::sqrt2 * AL[l]*std::cos (m*dirs (i,0));
-                SHT(i, index(l,-m)) = Math::sqrt2 * AL[l]*std::sin (m*dirs (i,0));
-              }
+          Matrix<value_type,Dynamic,Dynamic> AL (dirs.rows(), lmax+1);
+          const array_type x = dirs.col(1).array().cos();
+          Legendre::Plm_sph (AL, lmax, 0, x);
+          for (int l = 0; l <= lmax; l+=2)
+            SHT.col (index (l,0)) = AL.col(l);
+          array_type cos_m_az (dirs.rows()), sin_m_az (dirs.rows());
+          for (int m = 1; m <= lmax; m++) {
+            Legendre::Plm_sph (AL, lmax, m, x);
+            cos_m_az = (m*dirs.col(0).array()).cos();
+            sin_m_az = (m*dirs.col(0).array()).sin();
+            for (int l = ( (m&1) ? m+1 : m); l <= lmax; l+=2) {
+              SHT.col (index(l, m)).array() = Math::sqrt2 * AL.col(l).array() * cos_m_az;
+              SHT.col (index(l,-m)).array() = Math::sqrt2 * AL.col(l).array() * sin_m_az;
             }
           }
           return SHT;
@@ -104,6 +108,31 @@ namespace MR
 
 
 
+      //! form the SH->amplitudes matrix and its pseudo-inverse, reusing previous results
+      /*! This provides the matrices \a SHT (as computed by init_transform())
+       * and \a iSHT (its pseudo-inverse) for directions \a dirs up to harmonic
+       * degree \a lmax. The most recently used results are retained in a
+       * small process-wide cache keyed on the direction set and \a lmax, so
+       * that repeated requests (e.g. from different processing stages or
+       * threads) are not recomputed. Callers that only need \a SHT should use
+       * init_transform() instead. If the
+       * SHTransformCache config file option is set, the pseudo-inverse is
+       * also stored in that folder and reused across invocations. */
+      void cached_transform (const Eigen::MatrixXd& dirs, const int lmax, Eigen::MatrixXd& SHT, Eigen::MatrixXd& iSHT);
+
+      //! as above, for other value types and direction matrices
+      template <typename ValueType, class MatrixType>
+        void cached_transform (const MatrixType& dirs, const int lmax,
+            Eigen::Matrix<ValueType,Eigen::Dynamic,Eigen::Dynamic>& SHT,
+            Eigen::Matrix<ValueType,Eigen::Dynamic,Eigen::Dynamic>& iSHT)
+        {
+          Eigen::MatrixXd SHT_double, iSHT_double;
+          cached_transform (Eigen::MatrixXd (dirs.template cast<double>()), lmax, SHT_double, iSHT_double);
+          SHT = SHT_double.cast<ValueType>();
+          iSHT = iSHT_double.cast<ValueType>();
+        }
+
+
 
       //! scale the coefficients of each SH degree by the corresponding value in \a coefs
       template <class MatrixType, class VectorType>
@@ -154,9 +183,9 @@ namespace MR
           using matrix_type = Eigen::Matrix<ValueType,Eigen::Dynamic,Eigen::Dynamic>;
 
           template <class MatrixType>
-            Transform (const MatrixType& dirs, int lmax) :
-              SHT (init_transform (dirs, lmax)),
-              iSHT (pinv (SHT)) { }
+            Transform (const MatrixType& dirs, int lmax) {
+              cached_transform (dirs, lmax, SHT, iSHT);
+            }
 
           template <class VectorType>
             void set_filter (const VectorType& filter) {
@@ -134,7 +134,17 @@ namespace MR
             using matrix_type = Eigen::Matrix<value_type,Eigen::Dynamic,Eigen::Dynamic>;
             using vector_type = Eigen::Matrix<value_type,Eigen::Dynamic,1>;
 
-            Solver (const Problem<value_type>& problem) :
+            //! set up a solver for the given problem
+            /*! if \a warm_start is set, each call to operator() seeds its
+             * active set with the active set found by the previous call,
+             * which reduces the number of iterations required when successive
+             * calls are expected to have similar solutions (e.g. neighbouring
+             * voxels). Since the iterations stop as soon as no constraint is
+             * violated by more than the tolerance, the solution can differ
+             * slightly from that obtained from an empty active set, and
+             * hence depends on the preceding calls: use reset() to make the
+             * output reproducible (e.g. at the start of each row of voxels). */
+            Solver (const Problem<value_type>& problem, bool warm_start = false) :
               P (problem),
               BtB (P.chol_HtH.rows(), P.chol_HtH.cols()),
               B (P.B.rows(), P.B.cols()),
@@ -144,7 +154,11 @@ namespace MR
               lambda (c.size()),
               lambda_prev (c.size()),
               l (lambda.size()),
-              active (lambda.size(), false) { }
+              active (lambda.size(), false),
+              warm_start (warm_start) { }
+
+            //! empty the active set carried over between calls in warm-start mode
+            void reset () { std::fill (active.begin(), active.end(), false); }
 
             size_t operator() (vector_type& x, const vector_type& b) 
             {
@@ -160,8 +174,14 @@ namespace MR
               // set all Lagrangian multipliers to zero:
               lambda.setZero();
               lambda_prev.setZero();
+              // in warm-start mode, the first iteration re-estimates the
+              // Lagrangian multipliers for the previous active set (removing
+              // any that are negative for this problem), rather than adding
+              // the worst offending constraint to an empty active set:
+              bool warm = warm_start && std::find (active.begin(), active.end(), true) != active.end();
               // set active set empty:
-              std::fill (active.begin(), active.end(), false);
+              if (!warm)
+                std::fill (active.begin(), active.end(), false);
 
               // initial estimate of constraint values:
               c = c_u;
@@ -171,9 +191,12 @@ namespace MR
               size_t min_c_index;
               size_t niter = 0;
 
-              while (c.minCoeff (&min_c_index) < -P.tol) {
-                bool active_set_changed = !active[min_c_index];
-                active[min_c_index] = true;
+              while (warm || c.minCoeff (&min_c_index) < -P.tol) {
+                bool active_set_changed = false;
+                if (!warm) {
+                  active_set_changed = !active[min_c_index];
+                  active[min_c_index] = true;
+                }
 
                 while (1) {
                   // form submatrix of active constraints:
@@ -246,8 +269,9 @@ namespace MR
 #endif
 
                 ++niter;
-                if (!active_set_changed || niter > P.max_niter) 
+                if ((!warm && !active_set_changed) || niter > P.max_niter)
                   break;
+                warm = false;
 
                 // compute constraint values at updated solution:
                 c = P.B * x;
@@ -265,6 +289,7 @@ namespace MR
             matrix_type BtB, B;
             vector_type y_u, c, c_u, lambda, lambda_prev, l;
             vector<bool> active;
+            const bool warm_start;
         };
 
 
@@ -123,6 +123,49 @@ namespace MR
 
 
 
+      //* compute arrays of normalised associated Legendre functions for many arguments at once
+      /** This performs the same recursion as Plm_sph (VectorType&, const int, const int, const ValueType),
+       * simultaneously for all values in \a x, allowing the compiler to
+       * vectorise the computation across arguments.
+       * \note upon completion, the (l,m) value for argument \c x[i] will be
+       * stored in \c array(i,l). Columns of \a array for l<m will be left
+       * undefined. */
+      template <typename MatrixType, class Derived>
+        inline void Plm_sph (MatrixType& array, const int lmax, const int m, const Eigen::ArrayBase<Derived>& x)
+        {
+          using value_type = typename MatrixType::Scalar;
+          using array_type = Eigen::Array<value_type,Eigen::Dynamic,1>;
+          const array_type x2 = x.square();
+
+          array.col(m).setConstant (0.282094791773878);
+          if (m) {
+            array_type helper (array_type::Ones (x.size()));
+            for (int n = 2; n <= 2*m; n += 2)
+              helper = (1.0-x2) * (n-1.0) / n * helper;
+            array.col(m).array() *= (value_type (2*m+1) * helper).sqrt();
+          }
+          if (m & 1) array.col(m) = -array.col(m);
+
+          if (lmax > m) {
+            value_type f = std::sqrt (value_type (2*m+3));
+            array.col(m+1).array() = x * f * array.col(m).array();
+
+            for (int n = m+2; n <= lmax; n++) {
+              array.col(n).array() = x*array.col(n-1).array() - array.col(n-2).array()/f;
+              f = std::sqrt (value_type (4*pow2 (n)-1) / value_type (pow2 (n)-pow2 (m)));
+              array.col(n) *= f;
+            }
+          }
+
+          if (m) {
+            for (ssize_t i = 0; i < x.size(); ++i)
+              if (x2[i] >= 1.0)
+                array.row(i).segment (m, lmax+1-m).setZero();
+          }
+        }
+
+
+
       //* compute derivatives of normalised associated Legendre functions
       /** \note this function expects the previously computed array of associated Legendre functions to be stored in \a array,
        * (as computed by Plm_sph (VectorType& array, const int lmax, const int m, const ValueType x))
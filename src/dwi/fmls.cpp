@@ -15,6 +15,10 @@
 
 #include "dwi/fmls.h"
 
+#include <limits>
+
+#include "timer.h"
+
 
 
 namespace MR {
@@ -152,90 +156,164 @@ namespace MR {
         }
         transform.reset (new Math::SH::Transform<default_type> (az_el_pairs, lmax));
         weights.reset (new IntegrationWeights (dirs));
+        timings.reset (new Timings());
       }
 
 
 
 
-      class Max_abs { NOMEMALIGN
-        public:
-          bool operator() (const default_type& a, const default_type& b) const { return (abs (a) > abs (b)); }
-      };
+      Timings::~Timings ()
+      {
+        if (!num_voxels)
+          return;
+        const char* names[NUM_PHASES] = { "amplitudes", "sorting", "lobe growth", "peak refinement", "lookup tables" };
+        std::string report;
+        for (size_t i = 0; i != NUM_PHASES; ++i)
+          report += std::string (i ? ", " : "") + names[i] + " " + str (seconds[i], 3) + "s";
+        INFO ("FOD segmentation of " + str (num_voxels) + " voxels; processing time per phase: " + report);
+      }
+
 
-      bool Segmenter::operator() (const SH_coefs& in, FOD_lobes& out) const {
 
+
+      bool Segmenter::operator() (const SH_coefs& in, FOD_lobes& out) const
+      {
         assert (in.size() == ssize_t (Math::SH::NforL (lmax)));
+        default_type elapsed[Timings::NUM_PHASES] = { 0.0 };
+        Timer timer;
+        Eigen::Matrix<default_type, Eigen::Dynamic, 1> values (dirs.size());
+        transform->SH2A (values, in);
+        elapsed[Timings::AMPLITUDES] = timer.elapsed();
+        segment (in, values, out, elapsed);
+        timings->add (elapsed, 1);
+        return true;
+      }
+
+
+
+      bool Segmenter::operator() (const vector<SH_coefs>& in, vector<FOD_lobes>& out) const
+      {
+        default_type elapsed[Timings::NUM_PHASES] = { 0.0 };
+        Timer timer;
+
+        // Amplitudes of all FODs in the block from a single matrix multiplication
+        Eigen::Matrix<default_type, Eigen::Dynamic, Eigen::Dynamic> coefs (transform->n_SH(), in.size());
+        for (size_t n = 0; n != in.size(); ++n) {
+          assert (in[n].size() == ssize_t (Math::SH::NforL (lmax)));
+          coefs.col (n) = in[n];
+        }
+        const Eigen::Matrix<default_type, Eigen::Dynamic, Eigen::Dynamic> amplitudes (transform->mat_SH2A() * coefs);
+        elapsed[Timings::AMPLITUDES] = timer.elapsed();
+
+        out.resize (in.size());
+        Eigen::Matrix<default_type, Eigen::Dynamic, 1> values (dirs.size());
+        for (size_t n = 0; n != in.size(); ++n) {
+          values = amplitudes.col (n);
+          segment (in[n], values, out[n], elapsed);
+        }
+        timings->add (elapsed, in.size());
+        return true;
+      }
+
+
 
+      void Segmenter::segment (const SH_coefs& in, const Eigen::Matrix<default_type, Eigen::Dynamic, 1>& values, FOD_lobes& out, default_type* elapsed) const
+      {
         out.clear();
         out.vox = in.vox;
 
         if (in[0] <= 0.0 || !std::isfinite (in[0]))
-          return true;
+          return;
 
-        Eigen::Matrix<default_type, Eigen::Dynamic, 1> values (dirs.size());
-        transform->SH2A (values, in);
+        Timer timer;
 
-        using map_type = std::multimap<default_type, index_type, Max_abs>;
+        // No lobes are produced if the sample of largest magnitude is negative
+        index_type max_index = 0;
+        for (index_type d = 1; d != dirs.size(); ++d) {
+          if (abs (values[d]) > abs (values[max_index]))
+            max_index = d;
+        }
+        if (values[max_index] <= 0.0) {
+          elapsed[Timings::SORT] += timer.elapsed();
+          return;
+        }
 
-        map_type data_in_order;
-        for (size_t i = 0; i != size_t(values.size()); ++i)
-          data_in_order.insert (std::make_pair (values[i], i));
+        // Negative lobes are only ever adjacent to other negative lobes, and are
+        //   discarded once segmentation is complete; hence only the positive
+        //   samples need to be segmented. These are processed in order of
+        //   decreasing amplitude; ties retain the order of the directions themselves
+        vector< std::pair<default_type, index_type> > order;
+        order.reserve (dirs.size());
+        for (index_type d = 0; d != dirs.size(); ++d) {
+          if (values[d] > 0.0)
+            order.push_back (std::make_pair (-values[d], d));
+        }
+        std::sort (order.begin(), order.end());
+        elapsed[Timings::SORT] += timer.elapsed();
+        timer.start();
 
-        if (data_in_order.begin()->first <= 0.0)
-          return true;
+        // Index of the lobe to which each direction has been added (if any);
+        //   this is equivalent to testing the mask of every lobe for adjacency,
+        //   but only requires looking at the neighbours of each direction
+        const uint32_t unassigned = std::numeric_limits<uint32_t>::max();
+        vector<uint32_t> assignment (dirs.size(), unassigned);
 
         vector< std::pair<index_type, uint32_t> > retrospective_assignments;
+        vector<uint32_t> adj_lobes;
 
-        for (const auto& i : data_in_order) {
-
-          vector<uint32_t> adj_lobes;
-          for (uint32_t l = 0; l != out.size(); ++l) {
-            if ((((i.first <= 0.0) &&  out[l].is_negative())
-                  || ((i.first >  0.0) && !out[l].is_negative()))
-                && (out[l].get_mask().is_adjacent (i.second))) {
+        for (const auto& i : order) {
 
-              adj_lobes.push_back (l);
+          const index_type dir = i.second;
+          const default_type value = values[dir];
 
-            }
+          adj_lobes.clear();
+          for (const auto neighbour : dirs.get_adj_dirs (dir)) {
+            if (assignment[neighbour] != unassigned)
+              adj_lobes.push_back (assignment[neighbour]);
           }
+          std::sort (adj_lobes.begin(), adj_lobes.end());
+          adj_lobes.erase (std::unique (adj_lobes.begin(), adj_lobes.end()), adj_lobes.end());
 
           if (adj_lobes.empty()) {
 
-            out.push_back (FOD_lobe (dirs, i.second, i.first, (*weights)[i.second]));
+            assignment[dir] = out.size();
+            out.push_back (FOD_lobe (dirs, dir, value, (*weights)[dir]));
 
           } else if (adj_lobes.size() == 1) {
 
-            out[adj_lobes.front()].add (i.second, i.first, (*weights)[i.second]);
+            assignment[dir] = adj_lobes.front();
+            out[adj_lobes.front()].add (dir, value, (*weights)[dir]);
 
           } else {
 
             // Changed handling of lobe merges
             // Merge lobes as they appear to be merged, but update the
             //   contents of retrospective_assignments accordingly
-            if (abs (i.first) / out[adj_lobes.back()].get_max_peak_value() > ratio_of_peak_value_to_merge) {
+            if (abs (value) / out[adj_lobes.back()].get_max_peak_value() > ratio_of_peak_value_to_merge) {
 
-              std::sort (adj_lobes.begin(), adj_lobes.end());
               for (size_t j = 1; j != adj_lobes.size(); ++j)
                 out[adj_lobes[0]].merge (out[adj_lobes[j]]);
-              out[adj_lobes[0]].add (i.second, i.first, (*weights)[i.second]);
-              for (auto j = retrospective_assignments.begin(); j != retrospective_assignments.end(); ++j) {
-                bool modified = false;
+              out[adj_lobes[0]].add (dir, value, (*weights)[dir]);
+              // Compensate for impending deletion of elements from the vector
+              auto revised_index = [&] (const uint32_t lobe_index) {
                 for (size_t k = 1; k != adj_lobes.size(); ++k) {
-                  if (j->second == adj_lobes[k]) {
-                    j->second = adj_lobes[0];
-                    modified = true;
-                  }
+                  if (lobe_index == adj_lobes[k])
+                    return adj_lobes[0];
                 }
-                if (!modified) {
-                  // Compensate for impending deletion of elements from the vector
-                  uint32_t lobe_index = j->second;
-                  for (size_t k = adj_lobes.size() - 1; k; --k) {
-                    if (adj_lobes[k] < lobe_index)
-                      --lobe_index;
-                  }
-                  j->second = lobe_index;
+                uint32_t result = lobe_index;
+                for (size_t k = adj_lobes.size() - 1; k; --k) {
+                  if (adj_lobes[k] < lobe_index)
+                    --result;
                 }
+                return result;
+              };
+              for (auto& j : retrospective_assignments)
+                j.second = revised_index (j.second);
+              for (auto& j : assignment) {
+                if (j != unassigned)
+                  j = revised_index (j);
               }
+              assignment[dir] = adj_lobes[0];
               for (size_t j = adj_lobes.size() - 1; j; --j) {
                 vector<FOD_lobe>::iterator ptr = out.begin();
                 advance (ptr, adj_lobes[j]);
@@ -244,7 +322,7 @@ namespace MR {
 
             } else {
 
-              retrospective_assignments.push_back (std::make_pair (i.second, adj_lobes.front()));
+              retrospective_assignments.push_back (std::make_pair (dir, adj_lobes.front()));
 
             }
 
@@ -254,6 +332,8 @@ namespace MR {
 
         for (const auto& i : retrospective_assignments)
           out[i.second].add (i.first, values[i.first], (*weights)[i.first]);
+        elapsed[Timings::GROW] += timer.elapsed();
+        timer.start();
 
         for (auto i = out.begin(); i != out.end();) { // Empty increment
 
@@ -302,6 +382,9 @@ namespace MR {
           }
         }
 
+        elapsed[Timings::PEAKS] += timer.elapsed();
+        timer.start();
+
         if (create_lookup_table) {
 
           out.lut.assign (dirs.size(), out.size());
@@ -369,8 +452,7 @@ namespace MR {
           out.push_back (FOD_lobe (null_mask));
         }
 
-        return true;
-
+        elapsed[Timings::LOOKUP] += timer.elapsed();
       }
 
 
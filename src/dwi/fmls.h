@@ -16,7 +16,7 @@
 #ifndef __dwi_fmls_h__
 #define __dwi_fmls_h__
 
-#include <map> // Used for sorting FOD samples
+#include <mutex>
 
 #include "memory.h"
 #include "math/SH.h"
@@ -31,6 +31,10 @@
 #define FMLS_PEAK_VALUE_THRESHOLD_DEFAULT 0.1
 #define FMLS_RATIO_TO_PEAK_VALUE_TO_MERGE_DEFAULT 1.0 // By default, turn all peaks into lobes (discrete peaks are never merged)
 
+// Number of voxels passed between threads at a time when segmenting a whole image;
+//   the amplitudes of all FODs in such a block are computed using a single matrix multiplication
+#define FMLS_BLOCK_SIZE 256
+
 
 // By default, the mean direction of each FOD lobe is calculated by taking a weighted average of the
 //   Euclidean unit vectors (weights are FOD amplitudes). This is not strictly mathematically correct, and
@@ -208,6 +212,28 @@ namespace MR
             return true;
           }
 
+          // Provide up to FMLS_BLOCK_SIZE voxels at once, for use with the
+          //   block version of Segmenter::operator()
+          bool operator() (vector<SH_coefs>& out)
+          {
+            size_t count = 0;
+            out.resize (FMLS_BLOCK_SIZE);
+            for (; loop && count != FMLS_BLOCK_SIZE; ++loop) {
+              if (mask.valid()) {
+                assign_pos_of (fod, 0, 3).to (mask);
+                if (!mask.value())
+                  continue;
+              }
+              SH_coefs& coefs (out[count++]);
+              assign_pos_of (fod).to (coefs.vox);
+              coefs.resize (fod.size (3));
+              for (auto l = Loop (3) (fod); l; ++l)
+                coefs[fod.index(3)] = fod.value();
+            }
+            out.resize (count);
+            return count;
+          }
+
         private:
           FODImageType fod;
           MaskImageType mask;
@@ -231,12 +257,40 @@ namespace MR
 
 
 
+      // Accumulates the processing time spent in each phase of the segmentation
+      //   across all threads; this is reported once all copies of the segmenter
+      //   sharing this instance have been destroyed
+      class Timings { NOMEMALIGN
+        public:
+          enum phase_t { AMPLITUDES, SORT, GROW, PEAKS, LOOKUP, NUM_PHASES };
+
+          Timings () : num_voxels (0) { std::fill (seconds, seconds + NUM_PHASES, 0.0); }
+          ~Timings ();
+
+          void add (const default_type* elapsed, const size_t voxels)
+          {
+            std::lock_guard<std::mutex> lock (mutex);
+            for (size_t i = 0; i != NUM_PHASES; ++i)
+              seconds[i] += elapsed[i];
+            num_voxels += voxels;
+          }
+
+        private:
+          default_type seconds[NUM_PHASES];
+          size_t num_voxels;
+          std::mutex mutex;
+      };
+
+
+
+
       class Segmenter { MEMALIGN(Segmenter)
 
         public:
           Segmenter (const DWI::Directions::FastLookupSet&, const size_t);
 
           bool operator() (const SH_coefs&, FOD_lobes&) const;
+          bool operator() (const vector<SH_coefs>&, vector<FOD_lobes>&) const;
 
 
           default_type get_integral_threshold           ()               const { return integral_threshold; }
@@ -265,6 +319,7 @@ namespace MR
           std::shared_ptr<Math::SH::Transform    <default_type>> transform;
           std::shared_ptr<Math::SH::PrecomputedAL<default_type>> precomputer;
           std::shared_ptr<IntegrationWeights> weights;
+          std::shared_ptr<Timings> timings;
 
           default_type integral_threshold; // Integral of positive lobe must be at least this value
           default_type peak_value_threshold; // Absolute threshold for the peak amplitude of the lobe
@@ -282,6 +337,8 @@ namespace MR
               throw Exception ("For FOD segmentation, 'create_lookup_table' must be set in order for lookup tables to be dilated ('dilate_lookup_table')");
           }
 
+          void segment (const SH_coefs&, const Eigen::Matrix<default_type, Eigen::Dynamic, 1>&, FOD_lobes&, default_type*) const;
+
 #ifdef FMLS_OPTIMISE_MEAN_DIR
           void optimise_mean_dir (FOD_lobe&) const;
 #endif
@@ -250,32 +250,122 @@ namespace MR
           if (old_neg == neg)
             return true;
 
-          work.triangularView<Eigen::Lower>() = shared.Mt_M.triangularView<Eigen::Lower>();
-
-          if (neg.size()) {
-            for (size_t i = 0; i < neg.size(); i++)
-              HR_T.row (i) = shared.HR_trans.row (neg[i]);
-            auto HR_T_view = HR_T.topRows (neg.size());
-            work.triangularView<Eigen::Lower>() += HR_T_view.transpose() * HR_T_view;
-          }
-
-          F.noalias() = llt.compute (work.triangularView<Eigen::Lower>()).solve (Mt_b);
+          factorise (llt, old_neg, neg);
+          F.noalias() = llt.solve (Mt_b);
 
           old_neg = neg;
 
           return false;
         }
 
+
+        //! deconvolve a batch of voxels in one go
+        /*! The DW signals for each voxel are provided as the columns of \a
+         * DW_signals. Iterations proceed in lockstep across the batch, so that
+         * the initial estimates, the right-hand sides, and the constraint
+         * amplitudes of all voxels yet to converge are each computed as a single
+         * matrix product. On return, \a FODs holds the FOD coefficients of each
+         * voxel in its columns, and \a num_iterations the number of iterations
+         * each voxel required (equal to shared.niter if it did not converge). */
+        template <class MatrixType>
+          void solve_batch (const MatrixType& DW_signals, Eigen::MatrixXd& FODs, vector<size_t>& num_iterations) {
+            const ssize_t nvox = DW_signals.cols();
+            FODs.resize (shared.HR_trans.cols(), nvox);
+            FODs.topRows (shared.rconv.rows()).noalias() = shared.rconv * DW_signals;
+            FODs.bottomRows (FODs.rows()-shared.rconv.rows()).setZero();
+            batch_Mt_b.noalias() = shared.M.transpose() * DW_signals;
+
+            num_iterations.assign (nvox, shared.niter);
+            if (batch_llt.size() < size_t (nvox))
+              batch_llt.resize (nvox, Eigen::LLT<Eigen::MatrixXd> (work.rows()));
+            batch_neg.resize (nvox);
+            active.resize (nvox);
+            for (ssize_t v = 0; v < nvox; ++v) {
+              batch_neg[v].assign (1, -1);
+              active[v] = v;
+            }
+
+            for (size_t iter = 0; iter < shared.niter && active.size(); ++iter) {
+              batch_F.resize (FODs.rows(), active.size());
+              for (size_t j = 0; j < active.size(); ++j)
+                batch_F.col (j) = FODs.col (active[j]);
+              batch_HR_amps.noalias() = shared.HR_trans * batch_F;
+
+              size_t num_active = 0;
+              for (size_t j = 0; j < active.size(); ++j) {
+                const ssize_t v = active[j];
+                neg.clear();
+                for (ssize_t n = 0; n < batch_HR_amps.rows(); n++)
+                  if (batch_HR_amps (n, j) < shared.threshold)
+                    neg.push_back (n);
+
+                if (batch_neg[v] == neg) {
+                  num_iterations[v] = iter;
+                  continue;
+                }
+
+                factorise (batch_llt[v], batch_neg[v], neg);
+                FODs.col (v).noalias() = batch_llt[v].solve (batch_Mt_b.col (v));
+                std::swap (batch_neg[v], neg);
+                active[num_active++] = v;
+              }
+              active.resize (num_active);
+            }
+          }
+
         const Eigen::VectorXd& FOD () const { return F; }
 
 
         const Shared& shared;
 
       protected:
-        Eigen::MatrixXd work, HR_T;
+        Eigen::MatrixXd work, HR_T, batch_F, batch_HR_amps, batch_Mt_b;
         Eigen::VectorXd F, init_F, HR_amps, Mt_b;
         Eigen::LLT<Eigen::MatrixXd> llt;
         vector<int> neg, old_neg;
+        vector<Eigen::LLT<Eigen::MatrixXd>> batch_llt;
+        vector<vector<int>> batch_neg;
+        vector<ssize_t> active;
+
+
+        // bring the Cholesky factor of the normal matrix from active set
+        // old_neg to active set neg. Between successive iterations the active
+        // set usually changes by only a handful of constraints, in which case
+        // it is cheaper to apply one rank-1 update / downdate per added /
+        // removed constraint than to rebuild and refactorise the full matrix;
+        // the latter is used when the change is large, or if a downdate fails
+        // to preserve positive-definiteness.
+        void factorise (Eigen::LLT<Eigen::MatrixXd>& factor, const vector<int>& old_neg, const vector<int>& neg) {
+          if (old_neg.empty() || old_neg[0] >= 0) {
+            added.clear();
+            removed.clear();
+            std::set_difference (neg.begin(), neg.end(), old_neg.begin(), old_neg.end(), std::back_inserter (added));
+            std::set_difference (old_neg.begin(), old_neg.end(), neg.begin(), neg.end(), std::back_inserter (removed));
+            // each rank-1 update costs ~2n^2, a full rebuild ~(|neg|/2 + n/3) n^2:
+            if (12 * (added.size() + removed.size()) < 3 * neg.size() + 2 * size_t (work.rows())) {
+              for (auto n : added)
+                factor.rankUpdate (shared.HR_trans.row (n).transpose(), 1.0);
+              for (auto n : removed)
+                factor.rankUpdate (shared.HR_trans.row (n).transpose(), -1.0);
+              if (factor.info() == Eigen::Success)
+                return;
+            }
+          }
+
+          work.triangularView<Eigen::Lower>() = shared.Mt_M.triangularView<Eigen::Lower>();
+
+          if (neg.size()) {
+            for (size_t i = 0; i < neg.size(); i++)
+              HR_T.row (i) = shared.HR_trans.row (neg[i]);
+            auto HR_T_view = HR_T.topRows (neg.size());
+            work.triangularView<Eigen::Lower>() += HR_T_view.transpose() * HR_T_view;
+          }
+
+          factor.compute (work.triangularView<Eigen::Lower>());
+        }
+
+      private:
+        vector<int> added, removed;
     };
 
 
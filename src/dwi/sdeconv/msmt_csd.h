@@ -244,15 +244,20 @@ namespace MR
 
 
 
-          MSMT_CSD (const Shared& shared_data) :
+          //! if \a warm_start is set, each voxel is initialised from the
+          //! active set of the previous voxel processed by this instance,
+          //! until reset() is called
+          MSMT_CSD (const Shared& shared_data, bool warm_start = false) :
               niter (0),
               shared (shared_data),
-              solver (shared.problem) { }
+              solver (shared.problem, warm_start) { }
 
           void operator() (const Eigen::VectorXd& data, Eigen::VectorXd& output) {
             niter = solver (output, data);
           }
 
+          void reset () { solver.reset(); }
+
           size_t niter;
           const Shared& shared;
 
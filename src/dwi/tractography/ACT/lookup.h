@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#ifndef __dwi_tractography_act_lookup_h__
+#define __dwi_tractography_act_lookup_h__
+
+#include <array>
+
+#include "image.h"
+#include "transform.h"
+#include "types.h"
+#include "algo/loop.h"
+
+#include "dwi/tractography/ACT/tissues.h"
+
+
+// Value used to flag regions where tissue data must be interpolated
+#define ACT_MIXED_TISSUE 5
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace ACT
+      {
+
+
+        // Per-voxel classification of a 5TT image, indicating whether all eight
+        //   voxels contributing to trilinear interpolation within the voxel cell
+        //   beginning at that voxel contain the same pure tissue; within such
+        //   regions (typically the bulk of the WM), tissue data can be obtained
+        //   without any interpolation
+        class PureTissueLookup { MEMALIGN(PureTissueLookup)
+
+          public:
+            using transform_type = Eigen::Transform<float, 3, Eigen::AffineCompact>;
+
+            PureTissueLookup (Image<float> image) :
+                scanner2voxel (Transform (image).scanner2voxel.cast<float>()),
+                dim {{ size_t (image.size(0)), size_t (image.size(1)), size_t (image.size(2)) }},
+                cells (dim[0] * dim[1] * dim[2], ACT_MIXED_TISSUE)
+            {
+              for (size_t t = 0; t != 5; ++t) {
+                float values[5] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+                values[t] = 1.0f;
+                pure[t].set (values[0], values[1], values[2], values[3], values[4]);
+              }
+
+              vector<uint8_t> voxels (cells.size(), ACT_MIXED_TISSUE);
+              for (auto l = Loop (0, 3) (image); l; ++l) {
+                uint8_t tissue = ACT_MIXED_TISSUE;
+                bool mixed = false;
+                for (image.index(3) = 0; image.index(3) != 5; ++image.index(3)) {
+                  const float value = image.value();
+                  if (value >= 1.0f && tissue == ACT_MIXED_TISSUE)
+                    tissue = image.index(3);
+                  else if (!(value <= 0.0f))
+                    mixed = true;
+                }
+                if (!mixed)
+                  voxels[index (image.index(0), image.index(1), image.index(2))] = tissue;
+              }
+
+              // Cells that include the last voxel along any axis are never
+              //   flagged, as interpolation is modified at the image edges
+              size_t count = 0;
+              for (size_t z = 0; z + 1 < dim[2]; ++z) {
+                for (size_t y = 0; y + 1 < dim[1]; ++y) {
+                  for (size_t x = 0; x + 1 < dim[0]; ++x) {
+                    const uint8_t tissue = voxels[index (x, y, z)];
+                    if (tissue == ACT_MIXED_TISSUE)
+                      continue;
+                    if (voxels[index (x+1, y,   z  )] == tissue && voxels[index (x,   y+1, z  )] == tissue &&
+                        voxels[index (x+1, y+1, z  )] == tissue && voxels[index (x,   y,   z+1)] == tissue &&
+                        voxels[index (x+1, y,   z+1)] == tissue && voxels[index (x,   y+1, z+1)] == tissue &&
+                        voxels[index (x+1, y+1, z+1)] == tissue) {
+                      cells[index (x, y, z)] = tissue;
+                      ++count;
+                    }
+                  }
+                }
+              }
+              INFO ("ACT: " + str (100.0 * count / double (cells.size()), 3) + "% of 5TT image voxel cells lie within homogeneous tissue");
+            }
+
+
+            //! the pure tissue at a scanner-space position, or ACT_MIXED_TISSUE if interpolation is required
+            uint8_t operator() (const Eigen::Vector3f& pos) const
+            {
+              const Eigen::Vector3f v = scanner2voxel * pos;
+              if (!(v[0] >= 0.0f && v[1] >= 0.0f && v[2] >= 0.0f
+                    && v[0] < dim[0]-1 && v[1] < dim[1]-1 && v[2] < dim[2]-1))
+                return ACT_MIXED_TISSUE;
+              return cells[index (size_t (v[0]), size_t (v[1]), size_t (v[2]))];
+            }
+
+            const Tissues& tissues (const uint8_t tissue) const { assert (tissue < 5); return pure[tissue]; }
+
+
+          private:
+            const transform_type scanner2voxel;
+            const std::array<size_t,3> dim;
+            vector<uint8_t> cells;
+            Tissues pure[5];
+
+            size_t index (const size_t x, const size_t y, const size_t z) const { return x + dim[0] * (y + dim[1] * z); }
+
+        };
+
+
+      }
+    }
+  }
+}
+
+#endif
@@ -47,7 +47,16 @@ namespace MR
                 sgm_depth (0),
                 seed_in_sgm (false),
                 sgm_seed_to_wm (false),
-                act_image (shared.act().voxel) { }
+                act_shared (shared.act()),
+                act_image (act_shared.voxel),
+                cached_lookups (0),
+                interpolated_lookups (0) { }
+
+            ~ACT_Method_additions ()
+            {
+              act_shared.cached_lookups.fetch_add (cached_lookups, std::memory_order_relaxed);
+              act_shared.interpolated_lookups.fetch_add (interpolated_lookups, std::memory_order_relaxed);
+            }
 
             ACT_Method_additions (const ACT_Method_additions&) = delete;
             ACT_Method_additions() = delete;
@@ -132,6 +141,13 @@ namespace MR
 
             bool fetch_tissue_data (const Eigen::Vector3f& pos)
             {
+              const uint8_t tissue = (*act_shared.lookup) (pos);
+              if (tissue != ACT_MIXED_TISSUE) {
+                ++cached_lookups;
+                tissue_values = act_shared.lookup->tissues (tissue);
+                return true;
+              }
+              ++interpolated_lookups;
               if (!act_image.scanner (pos)) {
                 tissue_values.reset();
                 return false;
@@ -151,8 +167,10 @@ namespace MR
 
 
           private:
+            const ACT_Shared_additions& act_shared;
             Interp::Linear<Image<float>> act_image;
             Tissues tissue_values;
+            size_t cached_lookups, interpolated_lookups;
 
         };
 
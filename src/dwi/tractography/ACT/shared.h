@@ -16,8 +16,11 @@
 #ifndef __dwi_tractography_act_shared_h__
 #define __dwi_tractography_act_shared_h__
 
+#include <atomic>
+
 #include "memory.h"
 #include "dwi/tractography/ACT/gmwmi.h"
+#include "dwi/tractography/ACT/lookup.h"
 
 
 namespace MR
@@ -35,14 +38,25 @@ namespace MR
           public:
             ACT_Shared_additions (const std::string& path, Properties& property_set) :
               voxel (Image<float>::open (path)),
-              bt (false)
+              bt (false),
+              cached_lookups (0),
+              interpolated_lookups (0)
             {
               verify_5TT_image (voxel);
+              lookup.reset (new PureTissueLookup (voxel));
               property_set.set (bt, "backtrack");
               if (property_set.find ("crop_at_gmwmi") != property_set.end())
                 gmwmi_finder.reset (new GMWMI_finder (voxel));
             }
 
+            ~ACT_Shared_additions ()
+            {
+              const size_t total = cached_lookups + interpolated_lookups;
+              if (total)
+                INFO ("ACT tissue lookups: " + str (total) + ", of which " + str (100.0 * cached_lookups / double (total), 3)
+                      + "% were within homogeneous tissue and did not require interpolation");
+            }
+
 
             bool backtrack() const { return bt; }
 
@@ -59,6 +73,9 @@ namespace MR
             bool bt;
 
             std::unique_ptr<GMWMI_finder> gmwmi_finder;
+            std::unique_ptr<PureTissueLookup> lookup;
+
+            mutable std::atomic<size_t> cached_lookups, interpolated_lookups;
 
 
           protected:
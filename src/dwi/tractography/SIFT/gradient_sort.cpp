@@ -59,6 +59,26 @@ namespace MR
 
 
 
+      void Gradient_queue::assign (const vector<Cost_fn_gradient_sort>& gradients, const track_t stamp)
+      {
+        vector<Entry> entries;
+        for (const auto& i : gradients) {
+          if (i.get_gradient_per_unit_length() < 0.0)
+            entries.push_back (Entry (i, stamp));
+        }
+        queue = std::priority_queue<Entry, vector<Entry>, Comparator> (Comparator(), std::move (entries));
+      }
+
+
+
+      void Gradient_queue::push (const Cost_fn_gradient_sort& gradient, const track_t stamp)
+      {
+        if (gradient.get_gradient_per_unit_length() < 0.0)
+          queue.push (Entry (gradient, stamp));
+      }
+
+
+
       bool MT_gradient_vector_sorter::Sorter::operator() (const TrackIndexRange& in, VecItType& out) const
       {
         VecItType start      (data.begin() + in.first);
@@ -17,6 +17,7 @@
 #define __dwi_tractography_sift_sort_h__
 
 
+#include <queue>
 #include <set>
 
 #include "types.h"
@@ -150,6 +151,47 @@ namespace MR
 
 
 
+      // For incremental filtering, candidate streamlines are instead drawn from a priority queue:
+      // * Each entry in the queue is tagged with the number of streamlines that had been removed
+      //     at the time its gradient was calculated
+      // * If any of the fixels traversed by the candidate streamline have been modified since then,
+      //     its gradient is stale; it is recalculated and re-inserted into the queue, rather than
+      //     triggering a recalculation of the entire gradient vector
+      // * Streamlines with a non-negative gradient are not inserted into the queue
+      class Gradient_queue
+      { MEMALIGN(Gradient_queue)
+
+        public:
+          class Entry : public Cost_fn_gradient_sort
+          { MEMALIGN(Entry)
+            public:
+              Entry (const Cost_fn_gradient_sort& g, const track_t s) :
+                Cost_fn_gradient_sort (g),
+                stamp                 (s) { }
+              track_t get_stamp() const { return stamp; }
+            private:
+              track_t stamp;
+          };
+
+          void assign (const vector<Cost_fn_gradient_sort>&, const track_t);
+          void push (const Cost_fn_gradient_sort&, const track_t);
+
+          bool empty() const { return queue.empty(); }
+          const Entry& top() const { return queue.top(); }
+          void pop() { queue.pop(); }
+
+        private:
+          class Comparator { NOMEMALIGN
+            public:
+              bool operator() (const Entry& a, const Entry& b) const { return (a.get_gradient_per_unit_length() > b.get_gradient_per_unit_length()); }
+          };
+          std::priority_queue<Entry, vector<Entry>, Comparator> queue;
+
+      };
+
+
+
+
       }
     }
   }
@@ -26,6 +26,7 @@
 #include "dwi/directions/set.h"
 
 #include "dwi/tractography/file.h"
+#include "dwi/tractography/file_sharded.h"
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/streamline.h"
 
@@ -70,7 +71,7 @@ namespace MR
           }
           Model (const Model& that) = delete;
 
-          virtual ~Model ();
+          virtual ~Model () { }
 
 
           // Over-rides the function defined in ModelBase; need to build contributions member also
@@ -91,7 +92,7 @@ namespace MR
 
         protected:
           std::string tck_file_path;
-          vector<TrackContribution*> contributions;
+          TrackContributions contributions;
 
           using Fixel_map<Fixel>::accessor;
           using Fixel_map<Fixel>::begin;
@@ -107,9 +108,10 @@ namespace MR
           class TrackMappingWorker
           { MEMALIGN(TrackMappingWorker)
             public:
-              TrackMappingWorker (Model& i, const default_type upsample_ratio) :
+              TrackMappingWorker (Model& i, const default_type upsample_ratio, vector<TrackContributions::Arena>& arenas) :
                   master (i),
                   mapper (i.header(), i.dirs),
+                  arenas (arenas),
                   mutex (new std::mutex),
                   TD_sum (0.0),
                   fixel_TDs (master.fixels.size(), 0.0)
@@ -120,6 +122,7 @@ namespace MR
               TrackMappingWorker (const TrackMappingWorker& that) :
                   master (that.master),
                   mapper (that.mapper),
+                  arenas (that.arenas),
                   mutex (that.mutex),
                   TD_sum (0.0),
                   fixel_TDs (master.fixels.size(), 0.0) { }
@@ -128,21 +131,34 @@ namespace MR
             private:
               Model& master;
               Mapping::TrackMapperBase mapper;
+              vector<TrackContributions::Arena>& arenas;
               std::shared_ptr<std::mutex> mutex;
               double TD_sum;
               vector<double> fixel_TDs;
+              TrackContributions::Arena arena;
           };
 
           class FixelRemapper
           { MEMALIGN(FixelRemapper)
             public:
-              FixelRemapper (Model& i, vector<size_t>& r) :
+              FixelRemapper (Model& i, vector<size_t>& r, vector<TrackContributions::Arena>& arenas) :
                 master   (i),
-                remapper (r) { }
+                remapper (r),
+                arenas   (arenas),
+                mutex    (new std::mutex) { }
+              FixelRemapper (const FixelRemapper& that) :
+                master   (that.master),
+                remapper (that.remapper),
+                arenas   (that.arenas),
+                mutex    (that.mutex) { }
+              ~FixelRemapper();
               bool operator() (const TrackIndexRange&);
             private:
               Model& master;
               vector<size_t>& remapper;
+              vector<TrackContributions::Arena>& arenas;
+              std::shared_ptr<std::mutex> mutex;
+              TrackContributions::Arena arena;
           };
 
       };
@@ -151,50 +167,36 @@ namespace MR
 
 
 
-      template <class Fixel>
-      Model<Fixel>::~Model ()
-      {
-        for (vector<TrackContribution*>::iterator i = contributions.begin(); i != contributions.end(); ++i) {
-          if (*i) {
-            delete *i;
-            *i = nullptr;
-          }
-        }
-      }
-
-
-
-
       template <class Fixel>
       void Model<Fixel>::map_streamlines (const std::string& path)
       {
         Tractography::Properties properties;
-        Tractography::Reader<> file (path, properties);
+        Tractography::ShardedReader<> file (path, properties);
 
         const track_t count = (properties.find ("count") == properties.end()) ? 0 : to<track_t>(properties["count"]);
         if (!count)
           throw Exception ("Cannot map streamlines: track file " + Path::basename(path) + " is empty");
 
-        contributions.assign (count, nullptr);
-
+        vector<TrackContributions::Arena> arenas;
         {
           Mapping::TrackLoader loader (file, count);
-          TrackMappingWorker worker (*this, Mapping::determine_upsample_ratio (Fixel_map<Fixel>::header(), properties, 0.1));
+          TrackMappingWorker worker (*this, Mapping::determine_upsample_ratio (Fixel_map<Fixel>::header(), properties, 0.1), arenas);
           Thread::run_queue (loader,
                              Thread::batch (Tractography::Streamline<>()),
                              Thread::multi (worker));
         }
+        contributions.assign (count, arenas);
 
-        if (!contributions.back()) {
+        if (!contributions[count-1]) {
           track_t num_tracks = 0, max_index = 0;
           for (track_t i = 0; i != contributions.size(); ++i) {
             if (contributions[i]) {
               ++num_tracks;
               max_index = std::max (max_index, i);
             }
-            WARN ("Only " + str (num_tracks) + " tracks read from input track file; expected " + str (contributions.size()));
-            contributions.resize (max_index + 1);
           }
+          WARN ("Only " + str (num_tracks) + " tracks read from input track file; expected " + str (contributions.size()));
+          contributions.resize (max_index + 1);
         }
 
         tck_file_path = path;
@@ -251,9 +253,13 @@ namespace MR
 
         fixels.swap (new_fixels);
 
-        TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks(), "Removing excluded fixels");
-        FixelRemapper remapper (*this, fixel_index_mapping);
-        Thread::run_queue (writer, TrackIndexRange(), Thread::multi (remapper));
+        vector<TrackContributions::Arena> arenas;
+        {
+          TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks(), "Removing excluded fixels");
+          FixelRemapper remapper (*this, fixel_index_mapping, arenas);
+          Thread::run_queue (writer, TrackIndexRange(), Thread::multi (remapper));
+        }
+        contributions.assign (num_tracks(), arenas);
 
         TD_sum = 0.0;
         for (typename vector<Fixel>::const_iterator i = fixels.begin(); i != fixels.end(); ++i)
@@ -281,9 +287,9 @@ namespace MR
         VAR (sum_from_fixels);
         VAR (sum_from_fixels_weighted);
         double sum_from_tracks = 0.0;
-        for (vector<TrackContribution*>::const_iterator i = contributions.begin(); i != contributions.end(); ++i) {
-          if (*i)
-            sum_from_tracks += (*i)->get_total_contribution();
+        for (track_t i = 0; i != contributions.size(); ++i) {
+          if (contributions[i])
+            sum_from_tracks += contributions[i].get_total_contribution();
         }
         VAR (sum_from_tracks);
       }
@@ -302,7 +308,7 @@ namespace MR
         ProgressBar progress ("Writing non-contributing streamlines output file", contributions.size());
         track_t tck_counter = 0;
         while (reader (tck) && tck_counter < contributions.size()) {
-          if (contributions[tck_counter] && !contributions[tck_counter++]->get_total_contribution())
+          if (contributions[tck_counter] && !contributions[tck_counter++].get_total_contribution())
             writer (tck);
           else
             writer.skip();
@@ -325,6 +331,7 @@ namespace MR
         master.TD_sum += TD_sum;
         for (size_t i = 0; i != fixel_TDs.size(); ++i)
           master.fixels[i] += fixel_TDs[i];
+        arenas.push_back (std::move (arena));
       }
 
 
@@ -332,9 +339,6 @@ namespace MR
       template <class Fixel>
       bool Model<Fixel>::TrackMappingWorker::operator() (const Tractography::Streamline<>& in)
       {
-        assert (in.index < master.contributions.size());
-        assert (!master.contributions[in.index]);
-
         try {
 
           Mapping::SetDixel dixels;
@@ -358,7 +362,7 @@ namespace MR
             }
           }
 
-          master.contributions[in.index] = new TrackContribution (masked_contributions, total_contribution, total_length);
+          arena.add (in.index, masked_contributions, total_contribution, total_length);
 
           TD_sum += total_contribution;
           for (vector<Track_fixel_contribution>::const_iterator i = masked_contributions.begin(); i != masked_contributions.end(); ++i)
@@ -376,12 +380,21 @@ namespace MR
 
 
 
+      template <class Fixel>
+      Model<Fixel>::FixelRemapper::~FixelRemapper()
+      {
+        std::lock_guard<std::mutex> lock (*mutex);
+        arenas.push_back (std::move (arena));
+      }
+
+
+
       template <class Fixel>
       bool Model<Fixel>::FixelRemapper::operator() (const TrackIndexRange& in)
       {
         for (track_t track_index = in.first; track_index != in.second; ++track_index) {
-          if (master.contributions[track_index]) {
-            TrackContribution& this_cont (*master.contributions[track_index]);
+          const TrackContribution this_cont (master.contributions[track_index]);
+          if (this_cont) {
             vector<Track_fixel_contribution> new_cont;
             double total_contribution = 0.0;
             for (size_t i = 0; i != this_cont.dim(); ++i) {
@@ -391,9 +404,7 @@ namespace MR
                 total_contribution += this_cont[i].get_length() * master[new_index].get_weight();
               }
             }
-            TrackContribution* new_contribution = new TrackContribution (new_cont, total_contribution, this_cont.get_total_length());
-            delete master.contributions[track_index];
-            master.contributions[track_index] = new_contribution;
+            arena.add (track_index, new_cont, total_contribution, this_cont.get_total_length());
           }
         }
         return true;
@@ -23,6 +23,7 @@
 #include "dwi/directions/set.h"
 
 #include "dwi/tractography/file.h"
+#include "dwi/tractography/file_sharded.h"
 
 #include "dwi/tractography/ACT/tissues.h"
 
@@ -148,6 +149,7 @@ namespace MR
 
             virtual bool operator() (const FMLS::FOD_lobes& in);
             virtual bool operator() (const Mapping::SetDixel& in);
+            bool operator() (const vector<FMLS::FOD_lobes>& in);
 
             default_type calc_cost_function() const;
 
@@ -197,7 +199,7 @@ namespace MR
           DWI::FMLS::Segmenter fmls (dirs, Math::SH::LforN (data.size(3)));
           fmls.set_dilate_lookup_table (!App::get_options ("no_dilate_lut").size());
           fmls.set_create_null_lobe (App::get_options ("make_null_lobes").size());
-          Thread::run_queue (writer, Thread::batch (FMLS::SH_coefs()), Thread::multi (fmls), Thread::batch (FMLS::FOD_lobes()), *this);
+          Thread::run_queue (writer, vector<FMLS::SH_coefs>(), Thread::multi (fmls), vector<FMLS::FOD_lobes>(), *this);
           have_null_lobes = fmls.get_create_null_lobe();
         }
 
@@ -233,7 +235,7 @@ namespace MR
         void ModelBase<Fixel>::map_streamlines (const std::string& path)
         {
           Tractography::Properties properties;
-          Tractography::Reader<> file (path, properties);
+          Tractography::ShardedReader<> file (path, properties);
 
           const track_t count = (properties.find ("count") == properties.end()) ? 0 : to<track_t>(properties["count"]);
           if (!count)
@@ -279,6 +281,18 @@ namespace MR
 
 
 
+        template <class Fixel>
+        bool ModelBase<Fixel>::operator() (const vector<FMLS::FOD_lobes>& in)
+        {
+          for (const auto& i : in) {
+            if (!(*this) (i))
+              return false;
+          }
+          return true;
+        }
+
+
+
 
         template <class Fixel>
         bool ModelBase<Fixel>::operator() (const Mapping::SetDixel& in)
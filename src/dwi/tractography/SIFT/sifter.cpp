@@ -59,10 +59,10 @@ namespace MR
         vector<track_t> noncontributing_indices;
         for (track_t i = 0; i != contributions.size(); ++i) {
           if (contributions[i]) {
-            if (contributions[i]->get_total_contribution()) {
-              sum_contributing_length    += contributions[i]->get_total_length();
+            if (contributions[i].get_total_contribution()) {
+              sum_contributing_length    += contributions[i].get_total_length();
             } else {
-              sum_noncontributing_length += contributions[i]->get_total_length();
+              sum_noncontributing_length += contributions[i].get_total_length();
               noncontributing_indices.push_back (i);
             }
           }
@@ -83,6 +83,18 @@ namespace MR
         if (tracks_remaining < term_number)
           throw Exception ("Filtering failed; desired number of filtered streamlines is greater than or equal to the size of the input dataset");
 
+        // For incremental filtering: the number of contributing streamlines removed so far, and the
+        //   value of this counter at the most recent modification of each fixel
+        // Recalculated gradients use the current value of mu, and hence require the current rate of change
+        //   of the cost function with respect to mu; this is tracked using the sums of (weighted) TD^2 and
+        //   TD*FOD across fixels, which are updated as streamlines are removed
+        Gradient_queue queue;
+        track_t removal_count = 0;
+        vector<track_t> fixel_stamps;
+        double sum_TD_sq = 0.0, sum_TD_FOD = 0.0;
+        if (incremental)
+          fixel_stamps.assign (fixels.size(), 0);
+
         const double init_cf = calc_cost_function();
         unsigned int iteration = 0;
         double cf_end_iteration = init_cf;
@@ -129,8 +141,18 @@ namespace MR
           // Trying a heuristic for now; go for a sort size of 1000 following initial sort, assuming half of all
           //   remaining streamlines have a negative gradient
 
-          const track_t sort_size = std::min (std::ceil(num_tracks() / double(Thread::number_of_threads())), std::round (2000.0 * double(num_tracks()) / double(tracks_remaining)));
-          MT_gradient_vector_sorter sorter (gradient_vector, sort_size);
+          std::unique_ptr<MT_gradient_vector_sorter> sorter;
+          if (incremental) {
+            queue.assign (gradient_vector, removal_count);
+            sum_TD_sq = sum_TD_FOD = 0.0;
+            for (vector<Fixel>::const_iterator i = fixels.begin()+1; i != fixels.end(); ++i) {
+              sum_TD_sq  += i->get_weight() * Math::pow2 (i->get_TD());
+              sum_TD_FOD += i->get_weight() * i->get_TD() * i->get_FOD();
+            }
+          } else {
+            const track_t sort_size = std::min (std::ceil(num_tracks() / double(Thread::number_of_threads())), std::round (2000.0 * double(num_tracks()) / double(tracks_remaining)));
+            sorter.reset (new MT_gradient_vector_sorter (gradient_vector, sort_size));
+          }
 
           // Remove candidate streamlines one at a time, and correspondingly modify the fixels to which they were attributed
           removed_this_iteration = 0;
@@ -168,24 +190,54 @@ namespace MR
               noncontributing_indices.pop_back();
 
               // Remove this streamline, and adjust all of the relevant quantities
-              noncontributing_length_removed += contributions[to_remove]->get_total_length();
-              delete contributions[to_remove];
-              contributions[to_remove] = nullptr;
+              noncontributing_length_removed += contributions[to_remove].get_total_length();
+              contributions.remove (to_remove);
               ++removed_this_iteration;
               --tracks_remaining;
 
             } else { // Proceed as normal
 
-              const vector<Cost_fn_gradient_sort>::iterator candidate = sorter.get();
-              if (candidate == gradient_vector.end()) {
-                recalculate = POS_GRADIENT;
-                if (!removed_this_iteration)
-                  another_iteration = false;
-                goto end_iteration;
+              Cost_fn_gradient_sort candidate (num_tracks(), 0.0, 0.0);
+              if (incremental) {
+                // Candidates that traverse fixels modified since their gradient was calculated are
+                //   re-evaluated and returned to the queue, rather than being used with a stale gradient
+                bool found = false;
+                while (!found && !queue.empty()) {
+                  const Gradient_queue::Entry entry (queue.top());
+                  queue.pop();
+                  const TrackContribution entry_contribution (contributions[entry.get_tck_index()]);
+                  bool stale = false;
+                  for (size_t f = 0; !stale && f != entry_contribution.dim(); ++f)
+                    stale = fixel_stamps[entry_contribution[f].get_fixel_index()] > entry.get_stamp();
+                  if (stale) {
+                    const double roc_cf = 2.0 * ((mu() * sum_TD_sq) - sum_TD_FOD);
+                    const double gradient = calc_gradient (entry.get_tck_index(), mu(), roc_cf);
+                    const double grad_per_unit_length = entry_contribution.get_total_contribution() ? (gradient / entry_contribution.get_total_contribution()) : 0.0;
+                    queue.push (Cost_fn_gradient_sort (entry.get_tck_index(), gradient, grad_per_unit_length), removal_count);
+                  } else {
+                    candidate.set (entry.get_tck_index(), entry.get_cost_gradient(), entry.get_gradient_per_unit_length());
+                    found = true;
+                  }
+                }
+                if (!found) {
+                  recalculate = POS_GRADIENT;
+                  if (!removed_this_iteration)
+                    another_iteration = false;
+                  goto end_iteration;
+                }
+              } else {
+                const vector<Cost_fn_gradient_sort>::iterator next = sorter->get();
+                if (next == gradient_vector.end()) {
+                  recalculate = POS_GRADIENT;
+                  if (!removed_this_iteration)
+                    another_iteration = false;
+                  goto end_iteration;
+                }
+                candidate.set (next->get_tck_index(), next->get_cost_gradient(), next->get_gradient_per_unit_length());
               }
 
-              const track_t candidate_index = candidate->get_tck_index();
-              if (candidate->get_cost_gradient() >= 0.0) {
+              const track_t candidate_index = candidate.get_tck_index();
+              if (candidate.get_cost_gradient() >= 0.0) {
                 recalculate = POS_GRADIENT;
                 if (!removed_this_iteration)
                   another_iteration = false;
@@ -195,10 +247,10 @@ namespace MR
               assert (candidate_index != num_tracks());
               assert (contributions[candidate_index]);
 
-              const double streamline_density_ratio = candidate->get_cost_gradient() / (sum_contributing_length - contributing_length_removed);
+              const double streamline_density_ratio = candidate.get_cost_gradient() / (sum_contributing_length - contributing_length_removed);
               const double required_cf_change_ratio = - term_ratio * streamline_density_ratio * current_cf;
 
-              const TrackContribution& candidate_contribution (*contributions[candidate_index]);
+              const TrackContribution candidate_contribution (contributions[candidate_index]);
 
               const double old_mu = mu();
               const double new_mu = FOD_sum / (TD_sum - candidate_contribution.get_total_contribution());
@@ -219,19 +271,29 @@ namespace MR
               }
 
               const double required_cf_change_quantisation = enforce_quantisation ? (-0.5 * quantisation) : 0.0;
-              const double this_nonlinearity = (candidate->get_cost_gradient() - this_actual_cf_change);
+              const double this_nonlinearity = (candidate.get_cost_gradient() - this_actual_cf_change);
 
               if (this_actual_cf_change < std::min ( {required_cf_change_ratio, required_cf_change_quantisation, this_nonlinearity })) {
 
                 // Candidate streamline removal meets all criteria; remove from reconstruction
+                ++removal_count;
                 for (size_t f = 0; f != candidate_contribution.dim(); ++f) {
                   const Track_fixel_contribution& fixel_cont = candidate_contribution[f];
-                  fixels[fixel_cont.get_fixel_index()] -= fixel_cont.get_length();
+                  Fixel& this_fixel = fixels[fixel_cont.get_fixel_index()];
+                  if (incremental) {
+                    sum_TD_sq  -= this_fixel.get_weight() * Math::pow2 (this_fixel.get_TD());
+                    sum_TD_FOD -= this_fixel.get_weight() * this_fixel.get_TD() * this_fixel.get_FOD();
+                  }
+                  this_fixel -= fixel_cont.get_length();
+                  if (incremental) {
+                    sum_TD_sq  += this_fixel.get_weight() * Math::pow2 (this_fixel.get_TD());
+                    sum_TD_FOD += this_fixel.get_weight() * this_fixel.get_TD() * this_fixel.get_FOD();
+                    fixel_stamps[fixel_cont.get_fixel_index()] = removal_count;
+                  }
                 }
                 TD_sum -= candidate_contribution.get_total_contribution();
                 contributing_length_removed += candidate_contribution.get_total_length();
-                delete contributions[candidate_index];
-                contributions[candidate_index] = nullptr;
+                contributions.remove (candidate_index);
                 ++removed_this_iteration;
                 --tracks_remaining;
 
@@ -432,7 +494,7 @@ namespace MR
       {
         if (!contributions[index])
           return std::numeric_limits<double>::max();
-        const TrackContribution& tck_cont = *contributions[index];
+        const TrackContribution tck_cont (contributions[index]);
         const double TD_sum_if_removed = TD_sum - tck_cont.get_total_contribution();
         const double mu_if_removed = FOD_sum / TD_sum_if_removed;
         const double mu_change_if_removed = mu_if_removed - current_mu;
@@ -456,7 +518,7 @@ namespace MR
         for (track_t track_index = in.first; track_index != in.second; ++track_index) {
           if (master.contributions[track_index]) {
             const double gradient = master.calc_gradient (track_index, current_mu, current_roc_cost);
-            const double grad_per_unit_length = master.contributions[track_index]->get_total_contribution() ? (gradient / master.contributions[track_index]->get_total_contribution()) : 0.0;
+            const double grad_per_unit_length = master.contributions[track_index].get_total_contribution() ? (gradient / master.contributions[track_index].get_total_contribution()) : 0.0;
             gradient_vector[track_index].set (track_index, gradient, grad_per_unit_length);
           } else {
             gradient_vector[track_index].set (master.num_tracks(), 0.0, 0.0);
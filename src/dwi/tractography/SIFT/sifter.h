@@ -60,7 +60,8 @@ namespace MR
             term_number (0),
             term_ratio (0.0),
             term_mu (0.0),
-            enforce_quantisation (true) { }
+            enforce_quantisation (true),
+            incremental (false) { }
 
         SIFTer (const SIFTer& that) = delete;
 
@@ -77,6 +78,7 @@ namespace MR
         void set_term_ratio  (const float i)        { term_ratio = i; }
         void set_term_mu     (const float i)        { term_mu = i; }
         void set_csv_path    (const std::string& i) { csv_path = i; }
+        void set_incremental (const bool i)         { incremental = i; }
 
         void set_regular_outputs (const vector<int>&, const bool);
 
@@ -102,6 +104,7 @@ namespace MR
         float   term_ratio;
         double  term_mu;
         bool    enforce_quantisation;
+        bool    incremental;
         std::string csv_path;
 
 
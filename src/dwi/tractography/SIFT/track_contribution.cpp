@@ -30,6 +30,79 @@ namespace MR
         float Track_fixel_contribution::min_length_for_storage = 0.0;
 
 
+
+        void TrackContributions::assign (const track_t num_tracks, vector<Arena>& arenas)
+        {
+          data.clear();
+          offsets.assign (num_tracks + 1, 0);
+          total_contribution.assign (num_tracks, 0.0f);
+          total_length.assign (num_tracks, 0.0f);
+          present.resize (num_tracks);
+          present.clear();
+
+          for (const auto& arena : arenas) {
+            for (const auto& entry : arena.entries) {
+              assert (entry.index < num_tracks);
+              assert (!present[entry.index]);
+              offsets[entry.index+1] = entry.size;
+              total_contribution[entry.index] = entry.total_contribution;
+              total_length[entry.index] = entry.total_length;
+              present[entry.index] = true;
+            }
+          }
+          for (track_t i = 0; i != num_tracks; ++i)
+            offsets[i+1] += offsets[i];
+
+          data.resize (offsets.back());
+          for (auto& arena : arenas) {
+            auto source = arena.data.cbegin();
+            for (const auto& entry : arena.entries) {
+              std::copy (source, source + entry.size, data.begin() + offsets[entry.index]);
+              source += entry.size;
+            }
+            arena = Arena();
+          }
+        }
+
+
+
+        void TrackContributions::resize (const track_t num_tracks)
+        {
+          assert (num_tracks <= size());
+          offsets.resize (num_tracks + 1);
+          data.resize (offsets.back());
+          total_contribution.resize (num_tracks);
+          total_length.resize (num_tracks);
+          present.resize (num_tracks);
+        }
+
+
+
+        void FixelContributions::assign (const TrackContributions& in, const size_t num_fixels)
+        {
+          offsets.assign (num_fixels + 1, 0);
+          for (track_t i = 0; i != in.size(); ++i) {
+            const TrackContribution track (in[i]);
+            for (size_t j = 0; j != track.dim(); ++j)
+              ++offsets[track[j].get_fixel_index()+1];
+          }
+          for (size_t f = 0; f != num_fixels; ++f)
+            offsets[f+1] += offsets[f];
+
+          data.resize (offsets.back());
+          vector<uint64_t> positions (offsets.begin(), offsets.end()-1);
+          for (track_t i = 0; i != in.size(); ++i) {
+            const TrackContribution track (in[i]);
+            for (size_t j = 0; j != track.dim(); ++j) {
+              Entry& entry (data[positions[track[j].get_fixel_index()]++]);
+              entry.track = i;
+              entry.length = track[j].get_length();
+            }
+          }
+        }
+
+
+
       }
     }
   }
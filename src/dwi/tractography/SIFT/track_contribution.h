@@ -19,11 +19,13 @@
 
 #include <cstdint>
 
+#include "bitset.h"
 #include "header.h"
-#include "min_mem_array.h"
 
 #include "math/math.h"
 
+#include "dwi/tractography/SIFT/types.h"
+
 
 namespace MR
 {
@@ -127,27 +129,177 @@ class Track_fixel_contribution
 
 
 
-      class TrackContribution : public Min_mem_array<Track_fixel_contribution>
-      { MEMALIGN(TrackContribution)
+      //! A view of the fixel contributions of a single streamline
+      /*! This class does not own the underlying data, which is stored within
+       * the TrackContributions class; it is therefore only valid for as long
+       * as that data is neither re-assigned nor destroyed. A default-constructed
+       * instance (i.e. a streamline that has not been mapped, or that has been
+       * removed from the reconstruction) evaluates to false. */
+      class TrackContribution
+      { NOMEMALIGN
 
         public:
-        TrackContribution (const vector<Track_fixel_contribution>& in, const float c, const float l) :
-            Min_mem_array<Track_fixel_contribution> (in),
+        TrackContribution (const Track_fixel_contribution* data, const uint32_t size, const float c, const float l) :
+            data               (data),
+            size               (size),
             total_contribution (c),
-            total_length       (l) { }
+            total_length       (l),
+            valid              (true) { }
 
         TrackContribution () :
-            Min_mem_array<Track_fixel_contribution> (),
+            data               (nullptr),
+            size               (0),
             total_contribution (0.0),
-            total_length       (0.0) { }
+            total_length       (0.0),
+            valid              (false) { }
+
+        explicit operator bool() const { return valid; }
 
-        ~TrackContribution() { }
+        size_t dim() const { return size; }
+        const Track_fixel_contribution& operator[] (const size_t i) const { assert (i < size); return data[i]; }
 
         float get_total_contribution() const { return total_contribution; }
         float get_total_length      () const { return total_length; }
 
         private:
-          const float total_contribution, total_length;
+          const Track_fixel_contribution* data;
+          uint32_t size;
+          float total_contribution, total_length;
+          bool valid;
+
+      };
+
+
+
+
+      //! Storage of the fixel contributions of all streamlines
+      /*! Rather than allocating the contributions of each streamline
+       * individually, these are concatenated into a single contiguous array,
+       * with the location of the data for each streamline given by an array of
+       * offsets. Since streamlines are mapped in an arbitrary order by multiple
+       * threads, each thread stores its mapped streamlines into its own Arena;
+       * once mapping is complete, these are concatenated in order of streamline
+       * index using assign(). */
+      class TrackContributions
+      { MEMALIGN(TrackContributions)
+
+        public:
+
+          class Arena
+          { MEMALIGN(Arena)
+            public:
+              void add (const track_t index, const vector<Track_fixel_contribution>& contributions, const float total_contribution, const float total_length)
+              {
+                entries.push_back ({ index, uint32_t(contributions.size()), total_contribution, total_length });
+                data.insert (data.end(), contributions.begin(), contributions.end());
+              }
+            private:
+              class Entry
+              { NOMEMALIGN
+                public:
+                  track_t index;
+                  uint32_t size;
+                  float total_contribution, total_length;
+              };
+              vector<Entry> entries;
+              vector<Track_fixel_contribution> data;
+              friend class TrackContributions;
+          };
+
+
+          TrackContributions () :
+              present (0) { }
+
+          track_t size() const { return total_contribution.size(); }
+
+          TrackContribution operator[] (const track_t index) const
+          {
+            assert (index < size());
+            if (!present[index])
+              return TrackContribution();
+            return TrackContribution (data.data() + offsets[index], offsets[index+1] - offsets[index],
+                                      total_contribution[index], total_length[index]);
+          }
+
+          //! replace all data with the contents of \a arenas
+          /*! Any streamline index not present in any arena is flagged as
+           * absent. The arenas are emptied in the process. */
+          void assign (const track_t num_tracks, vector<Arena>& arenas);
+
+          //! exclude a streamline from the reconstruction
+          /*! Its data are retained in memory, but will no longer be
+           * accessible. Different streamlines can be removed concurrently. */
+          void remove (const track_t index) { present[index] = false; }
+
+          //! truncate to \a num_tracks streamlines
+          void resize (const track_t num_tracks);
+
+        private:
+          vector<Track_fixel_contribution> data;
+          vector<uint64_t> offsets;
+          vector<float> total_contribution, total_length;
+          BitSet present;
+
+      };
+
+
+
+
+      //! The contributions of all streamlines, indexed by fixel
+      /*! This is the transpose of TrackContributions: for each fixel, the
+       * streamlines traversing that fixel (in increasing order of streamline
+       * index) and the length of each within the fixel are stored
+       * contiguously. This allows quantities that are summed over streamlines
+       * within each fixel to be calculated by iterating over fixels, such that
+       * multiple threads can operate on disjoint ranges of fixels without
+       * needing a copy of the fixel data for each thread. */
+      class FixelContributions
+      { MEMALIGN(FixelContributions)
+
+        public:
+
+          class Entry
+          { NOMEMALIGN
+            public:
+              track_t get_track_index() const { return track; }
+              float   get_length()      const { return length; }
+            private:
+              track_t track;
+              float length;
+              friend class FixelContributions;
+          };
+
+          //! A view of the streamline contributions to a single fixel
+          class View
+          { NOMEMALIGN
+            public:
+              View (const Entry* data, const size_t size) :
+                  data (data),
+                  size (size) { }
+              size_t dim() const { return size; }
+              const Entry& operator[] (const size_t i) const { assert (i < size); return data[i]; }
+            private:
+              const Entry* data;
+              size_t size;
+          };
+
+
+          size_t size() const { return offsets.size() ? offsets.size() - 1 : 0; }
+
+          View operator[] (const size_t fixel) const
+          {
+            assert (fixel < size());
+            return View (data.data() + offsets[fixel], offsets[fixel+1] - offsets[fixel]);
+          }
+
+          //! construct from the streamline contributions \a in, for \a num_fixels fixels
+          void assign (const TrackContributions& in, const size_t num_fixels);
+
+          void clear() { data.clear(); data.shrink_to_fit(); offsets.clear(); offsets.shrink_to_fit(); }
+
+        private:
+          vector<Entry> data;
+          vector<uint64_t> offsets;
 
       };
 
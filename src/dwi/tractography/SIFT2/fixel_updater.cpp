@@ -13,8 +13,6 @@
  */
 
 
-#include <mutex>
-
 #include "dwi/tractography/SIFT2/fixel_updater.h"
 #include "dwi/tractography/SIFT2/tckfactor.h"
 
@@ -31,37 +29,23 @@ namespace MR {
 
 
       FixelUpdater::FixelUpdater (TckFactor& tckfactor) :
-          master (tckfactor),
-          fixel_coeff_sums (tckfactor.fixels.size(), 0.0),
-          fixel_TDs        (tckfactor.fixels.size(), 0.0),
-          fixel_counts     (tckfactor.fixels.size(), 0) { }
-
-
-
-      FixelUpdater::~FixelUpdater()
-      {
-        std::lock_guard<std::mutex> lock (master.mutex);
-        for (size_t i = 0; i != master.fixels.size(); ++i) {
-          master.fixels[i].add_to_mean_coeff (fixel_coeff_sums[i]);
-          master.fixels[i].add_TD (fixel_TDs[i], fixel_counts[i]);
-        }
-      }
+          master (tckfactor) { }
 
 
 
       bool FixelUpdater::operator() (const SIFT::TrackIndexRange& range)
       {
-        for (SIFT::track_t track_index = range.first; track_index != range.second; ++track_index) {
-          const double coefficient = master.coefficients[track_index];
-          const SIFT::TrackContribution& this_contribution (*(master.contributions[track_index]));
-          const double weighting_factor = (coefficient > master.min_coeff) ? std::exp (coefficient) : 0.0;
+        for (size_t fixel_index = range.first; fixel_index != range.second; ++fixel_index) {
+          const SIFT::FixelContributions::View this_contribution (master.fixel_contributions[fixel_index]);
+          double coeff_sum = 0.0, TD = 0.0;
           for (size_t j = 0; j != this_contribution.dim(); ++j) {
-            const size_t fixel_index = this_contribution[j].get_fixel_index();
+            const SIFT::track_t track_index = this_contribution[j].get_track_index();
             const float length = this_contribution[j].get_length();
-            fixel_coeff_sums[fixel_index] += length * coefficient;
-            fixel_TDs       [fixel_index] += length * weighting_factor;
-            fixel_counts    [fixel_index]++;
+            coeff_sum += length * master.coefficients[track_index];
+            TD        += length * master.weighting_factors[track_index];
           }
+          master.fixels[fixel_index].add_to_mean_coeff (coeff_sum);
+          master.fixels[fixel_index].add_TD (TD, this_contribution.dim());
         }
         return true;
       }
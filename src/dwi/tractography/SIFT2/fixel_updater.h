@@ -32,23 +32,21 @@ namespace MR {
       class TckFactor;
 
 
+      // Calculates the streamline density and mean weighting coefficient in each fixel
+      // The input queue provides ranges of fixel indices (rather than streamline indices); since the
+      //   streamlines traversing each fixel are read from TckFactor::fixel_contributions, each thread
+      //   writes only to the fixels within its own range
       class FixelUpdater
       { MEMALIGN(FixelUpdater)
 
         public:
           FixelUpdater (TckFactor&);
-          ~FixelUpdater();
 
           bool operator() (const SIFT::TrackIndexRange& range);
 
         private:
           TckFactor& master;
 
-          // Each thread needs a local copy of these
-          vector<double> fixel_coeff_sums;
-          vector<double> fixel_TDs;
-          vector<SIFT::track_t> fixel_counts;
-
       };
 
 
@@ -16,6 +16,7 @@
 #include "bitset.h"
 #include "header.h"
 #include "image.h"
+#include "timer.h"
 
 #include "math/math.h"
 
@@ -114,7 +115,7 @@ namespace MR {
         TD_sum = 0.0;
 
         for (SIFT::track_t track_index = 0; track_index != num_tracks(); ++track_index) {
-          const SIFT::TrackContribution& tck_cont (*contributions[track_index]);
+          const SIFT::TrackContribution tck_cont (contributions[track_index]);
           const double weight = 1.0 / tck_cont.get_total_length();
           coefficients[track_index] = std::log (weight);
           for (size_t i = 0; i != tck_cont.dim(); ++i)
@@ -151,7 +152,7 @@ namespace MR {
 
         // Just do single-threaded for now
         for (SIFT::track_t i = 0; i != num_tracks(); ++i) {
-          const SIFT::TrackContribution& tckcont = *contributions[i];
+          const SIFT::TrackContribution tckcont (contributions[i]);
           double sum_afd = 0.0;
           for (size_t f = 0; f != tckcont.dim(); ++f) {
             const size_t fixel_index = tckcont[f].get_fixel_index();
@@ -163,15 +164,9 @@ namespace MR {
           coefficients[i] = std::log (afcsa / fixed_mu);
         }
 
-        for (vector<Fixel>::iterator i = fixels.begin(); i != fixels.end(); ++i) {
-          i->clear_TD();
-          i->clear_mean_coeff();
-        }
-        {
-          SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
-          FixelUpdater worker (*this);
-          Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (worker));
-        }
+        fixel_contributions.assign (contributions, fixels.size());
+        update_fixels();
+        fixel_contributions.clear();
 
         VAR (calc_cost_function());
 
@@ -198,7 +193,7 @@ namespace MR {
 
         unsigned int nonzero_streamlines = 0;
         for (SIFT::track_t i = 0; i != num_tracks(); ++i) {
-          if (contributions[i] && contributions[i]->dim())
+          if (contributions[i] && contributions[i].dim())
             ++nonzero_streamlines;
         }
 
@@ -219,8 +214,8 @@ namespace MR {
         if (!csv_path.empty()) {
           csv_out.reset (new std::ofstream());
           csv_out->open (csv_path.c_str(), std::ios_base::trunc);
-          (*csv_out) << "Iteration,Cost_data,Cost_reg_tik,Cost_reg_tv,Cost_reg,Cost_total,Streamlines,Fixels_excluded,Step_min,Step_mean,Step_mean_abs,Step_var,Step_max,Coeff_min,Coeff_mean,Coeff_mean_abs,Coeff_var,Coeff_max,Coeff_norm,\n";
-          (*csv_out) << "0," << init_cf << ",0,0,0," << init_cf << "," << nonzero_streamlines << "," << total_excluded << ",0,0,0,0,0,0,0,0,0,0,0,\n";
+          (*csv_out) << "Iteration,Cost_data,Cost_reg_tik,Cost_reg_tv,Cost_reg,Cost_total,Streamlines,Fixels_excluded,Step_min,Step_mean,Step_mean_abs,Step_var,Step_max,Coeff_min,Coeff_mean,Coeff_mean_abs,Coeff_var,Coeff_max,Coeff_norm,Time_coefficients,Time_fixels,Time_regularisation,\n";
+          (*csv_out) << "0," << init_cf << ",0,0,0," << init_cf << "," << nonzero_streamlines << "," << total_excluded << ",0,0,0,0,0,0,0,0,0,0,0,0,0,0,\n";
           csv_out->flush();
         }
 
@@ -233,11 +228,21 @@ namespace MR {
         //   due to driving streamlines to unwanted high weights
         BitSet fixels_to_exclude (fixels.size());
 
+        // Fixel-major copy of the streamline contributions, such that the fixel update can be
+        //   performed in parallel across fixels
+        fixel_contributions.assign (contributions, fixels.size());
+
+        Timer timer;
+
         do {
 
           ++iter;
           prev_cf = new_cf;
 
+          // Per-iteration timing of the individual passes, in seconds
+          double time_coefficients, time_fixels, time_regularisation;
+          timer.start();
+
           // Line search to optimise each coefficient
           StreamlineStats step_stats, coefficient_stats;
           nonzero_streamlines = 0;
@@ -252,6 +257,7 @@ namespace MR {
           }
           step_stats.normalise();
           coefficient_stats.normalise();
+          time_coefficients = timer.elapsed();
           indicate_progress();
 
           // Perform fixel exclusion
@@ -266,18 +272,12 @@ namespace MR {
           }
 
           // Multi-threaded calculation of updated streamline density, and mean weighting coefficient, in each fixel
-          for (vector<Fixel>::iterator i = fixels.begin(); i != fixels.end(); ++i) {
-            i->clear_TD();
-            i->clear_mean_coeff();
-          }
-          {
-            SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
-            FixelUpdater worker (*this);
-            Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (worker));
-          }
+          timer.start();
+          update_fixels();
           // Scale the fixel mean coefficient terms (each streamline in the fixel is weighted by its length)
           for (vector<Fixel>::iterator i = fixels.begin(); i != fixels.end(); ++i)
             i->normalise_mean_coeff();
+          time_fixels = timer.elapsed();
           indicate_progress();
 
           cf_data = calc_cost_function();
@@ -286,6 +286,7 @@ namespace MR {
           //   streamline weighting coefficients and the new fixel mean coefficients
           // Log different regularisation costs separately
           double cf_reg_tik = 0.0, cf_reg_tv = 0.0;
+          timer.start();
           {
             SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
             RegularisationCalculator worker (*this, cf_reg_tik, cf_reg_tv);
@@ -293,6 +294,8 @@ namespace MR {
           }
           cf_reg_tik *= reg_multiplier_tikhonov;
           cf_reg_tv  *= reg_multiplier_tv;
+          time_regularisation = timer.elapsed();
+          DEBUG ("Iteration " + str(iter) + " timing: coefficients " + str(time_coefficients) + "s, fixels " + str(time_fixels) + "s, regularisation " + str(time_regularisation) + "s");
 
           cf_reg = cf_reg_tik + cf_reg_tv;
 
@@ -302,7 +305,8 @@ namespace MR {
             (*csv_out) << str (iter) << "," << str (cf_data) << "," << str (cf_reg_tik) << "," << str (cf_reg_tv) << "," << str (cf_reg) << "," << str (new_cf) << "," << str (nonzero_streamlines) << "," << str (total_excluded) << ","
                 << str (step_stats       .get_min()) << "," << str (step_stats       .get_mean()) << "," << str (step_stats       .get_mean_abs()) << "," << str (step_stats       .get_var()) << "," << str (step_stats       .get_max()) << ","
                 << str (coefficient_stats.get_min()) << "," << str (coefficient_stats.get_mean()) << "," << str (coefficient_stats.get_mean_abs()) << "," << str (coefficient_stats.get_var()) << "," << str (coefficient_stats.get_max()) << ","
-                << str (coefficient_stats.get_var() * (num_tracks() - 1))
+                << str (coefficient_stats.get_var() * (num_tracks() - 1)) << ","
+                << str (time_coefficients) << "," << str (time_fixels) << "," << str (time_regularisation)
                 << ",\n";
             csv_out->flush();
           }
@@ -313,6 +317,27 @@ namespace MR {
         } while (((new_cf - prev_cf < required_cf_change) || (iter < min_iters) /* || !fixels_to_exclude.empty() */ ) && (iter < max_iters));
 
         progress.done();
+        fixel_contributions.clear();
+      }
+
+
+
+
+      void TckFactor::update_fixels()
+      {
+        assert (fixel_contributions.size() == fixels.size());
+        for (vector<Fixel>::iterator i = fixels.begin(); i != fixels.end(); ++i) {
+          i->clear_TD();
+          i->clear_mean_coeff();
+        }
+        weighting_factors.resize (num_tracks());
+        for (SIFT::track_t i = 0; i != num_tracks(); ++i)
+          weighting_factors[i] = (coefficients[i] > min_coeff) ? std::exp (coefficients[i]) : 0.0;
+        {
+          SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, fixels.size());
+          FixelUpdater worker (*this);
+          Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (worker));
+        }
       }
 
 
@@ -358,7 +383,7 @@ namespace MR {
           ProgressBar progress ("Generating streamline coefficient statistic images", num_tracks());
           for (SIFT::track_t i = 0; i != num_tracks(); ++i) {
             const double coeff = coefficients[i];
-            const SIFT::TrackContribution& this_contribution (*contributions[i]);
+            const SIFT::TrackContribution this_contribution (contributions[i]);
             if (coeff > min_coeff) {
               for (size_t j = 0; j != this_contribution.dim(); ++j) {
                 const size_t fixel_index = this_contribution[j].get_fixel_index();
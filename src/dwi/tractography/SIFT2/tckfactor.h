@@ -110,6 +110,11 @@ namespace MR {
         private:
           Eigen::Array<default_type, Eigen::Dynamic, 1> coefficients;
 
+          // For calculation of fixel streamline densities: the weighting factor of each streamline, and
+          //   the streamline contributions indexed by fixel (only populated while this is required)
+          Eigen::Array<default_type, Eigen::Dynamic, 1> weighting_factors;
+          SIFT::FixelContributions fixel_contributions;
+
           double reg_multiplier_tikhonov, reg_multiplier_tv;
           size_t min_iters, max_iters;
           double min_coeff, max_coeff, max_coeff_step, min_cf_decrease_percentage;
@@ -132,6 +137,9 @@ namespace MR {
 
           void indicate_progress() { if (App::log_level) fprintf (stderr, "."); }
 
+          // Re-calculate the streamline density and mean weighting coefficient in each fixel
+          void update_fixels();
+
       };
 
 
@@ -13,6 +13,9 @@
  */
 
 
+#include <fstream>
+#include <map>
+
 #include "dwi/tractography/editing/editing.h"
 
 
@@ -121,6 +124,73 @@ void load_properties (Tractography::Properties& properties)
 
 
 
+
+vector<Bundle> load_bundles (const std::string& path, const Tractography::Properties& properties, ROISet& rois)
+{
+  std::ifstream stream (path, std::ios_base::in);
+  if (!stream)
+    throw Exception ("Unable to open bundle specification file \"" + path + "\"");
+
+  // Each distinct ROI specification is only loaded once
+  std::map<std::string, size_t> roi_indices;
+  std::map<std::string, ROI> masks;
+  vector<Bundle> bundles;
+  std::string sbuf;
+  size_t line = 0;
+
+  while (getline (stream, sbuf)) {
+    ++line;
+    sbuf = strip (sbuf.substr (0, sbuf.find_first_of ('#')));
+    if (sbuf.empty())
+      continue;
+
+    const auto elements = MR::split (sbuf, " \t", true);
+    Bundle bundle;
+    bundle.path = elements[0];
+    for (const auto& b : bundles) {
+      if (b.path == bundle.path)
+        throw Exception ("Output file \"" + bundle.path + "\" appears more than once in bundle specification file \"" + path + "\"");
+    }
+    for (size_t i = 0; i != properties.mask.size(); ++i)
+      bundle.mask.add (properties.mask[i]);
+
+    for (size_t i = 1; i != elements.size(); ++i) {
+      const auto split_point = elements[i].find ('=');
+      const std::string type = elements[i].substr (0, split_point);
+      if (split_point == std::string::npos || (type != "include" && type != "exclude" && type != "mask"))
+        throw Exception ("Malformed ROI specification \"" + elements[i] + "\" on line " + str(line) + " of bundle specification file \"" + path + "\""
+                         " (expected include=spec, exclude=spec or mask=spec)");
+      const std::string spec = elements[i].substr (split_point + 1);
+      if (type == "mask") {
+        auto existing = masks.find (spec);
+        if (existing == masks.end())
+          existing = masks.insert (std::make_pair (spec, ROI (spec))).first;
+        bundle.mask.add (existing->second);
+        continue;
+      }
+      auto existing = roi_indices.find (spec);
+      if (existing == roi_indices.end()) {
+        existing = roi_indices.insert (std::make_pair (spec, rois.size())).first;
+        rois.add (ROI (spec));
+      }
+      (type == "include" ? bundle.include : bundle.exclude).push_back (existing->second);
+    }
+
+    bundles.push_back (bundle);
+  }
+  if (stream.bad())
+    throw Exception (strerror (errno));
+
+  if (bundles.empty())
+    throw Exception ("No bundles defined in bundle specification file \"" + path + "\"");
+
+  INFO (str(bundles.size()) + " bundles defined using " + str(rois.size()) + " distinct include / exclude ROIs");
+  return bundles;
+}
+
+
+
+
 }
 }
 }
@@ -19,6 +19,7 @@
 #include "app.h"
 
 #include "dwi/tractography/properties.h"
+#include "dwi/tractography/roi.h"
 
 namespace MR {
 namespace DWI {
@@ -36,6 +37,24 @@ void load_properties (Tractography::Properties&);
 
 
 
+// Criteria for one of multiple bundles to be extracted in a single pass
+class Bundle { MEMALIGN(Bundle)
+  public:
+    std::string path;
+    // Indices into a set of include / exclude ROIs shared between all bundles
+    vector<size_t> include, exclude;
+    // Includes any mask ROIs common to all bundles
+    ROISet mask;
+};
+
+// Parse a bundle specification file: one bundle per line, consisting of the
+//   output track file path followed by whitespace-separated ROI specifications
+//   of the form include=spec, exclude=spec or mask=spec; each distinct ROI is
+//   loaded only once, regardless of how many bundles make use of it
+vector<Bundle> load_bundles (const std::string& path, const Tractography::Properties&, ROISet& rois);
+
+
+
 }
 }
 }
@@ -81,6 +81,74 @@ namespace MR {
 
 
 
+
+
+
+
+
+
+        BundleReceiver::BundleReceiver (const std::string& path, const Properties& properties, const vector<Bundle>& bundles, const ROISet& rois, const size_t n, const size_t s) :
+            active (bundles.size() + 1, true),
+            num_active (bundles.size() + 1),
+            total_count (0),
+            progress ("       0 read,        0 written to " + str(bundles.size()) + " bundles,        0 unassigned")
+        {
+          // Share the default write-back buffer size between all outputs
+          const size_t buffer_capacity = std::max (size_t(16777216) / (bundles.size() + 1), size_t(1048576));
+          receivers.push_back (std::unique_ptr<Receiver> (new Receiver (path, properties, n, s, buffer_capacity, false)));
+          for (const auto& bundle : bundles) {
+            // Properties is not copy-constructible (due to seeding), but seeds
+            //   are not relevant here
+            Properties bundle_properties;
+            static_cast<std::map<std::string, std::string>&> (bundle_properties) = properties;
+            bundle_properties.include = properties.include;
+            bundle_properties.exclude = properties.exclude;
+            bundle_properties.comments = properties.comments;
+            bundle_properties.roi = properties.roi;
+            for (auto i : bundle.include)
+              bundle_properties.include.add (rois[i]);
+            for (auto i : bundle.exclude)
+              bundle_properties.exclude.add (rois[i]);
+            for (size_t i = 0; i != bundle.mask.size(); ++i)
+              bundle_properties.mask.add (bundle.mask[i]);
+            receivers.push_back (std::unique_ptr<Receiver> (new Receiver (bundle.path, bundle_properties, n, s, buffer_capacity, false)));
+          }
+        }
+
+
+
+        bool BundleReceiver::operator() (const vector<Streamline<>>& in)
+        {
+          assert (in.size() == receivers.size());
+          ++total_count;
+          for (size_t i = 0; i != receivers.size(); ++i) {
+            if (active[i] && !(*receivers[i]) (in[i])) {
+              active[i] = false;
+              --num_active;
+            }
+          }
+          progress.update ([&] { return display_text(); });
+          return num_active;
+        }
+
+
+
+        std::string BundleReceiver::display_text () const
+        {
+          uint64_t count = 0, assigned = 0;
+          for (size_t i = 0; i != receivers.size(); ++i) {
+            count += receivers[i]->written();
+            if (i)
+              assigned += receivers[i]->written();
+          }
+          return printf ("%8" PRIu64 " read, %8" PRIu64 " written to ", total_count, assigned)
+                 + str(receivers.size() - 1) + printf (" bundles, %8" PRIu64 " unassigned", count - assigned);
+        }
+
+
+
+
+
       }
     }
   }
@@ -20,12 +20,17 @@
 #include <string>
 #include <cinttypes>
 
+#include "memory.h"
 #include "progressbar.h"
+#include "types.h"
 
 #include "dwi/tractography/file.h"
 #include "dwi/tractography/properties.h"
+#include "dwi/tractography/roi.h"
 #include "dwi/tractography/streamline.h"
 
+#include "dwi/tractography/editing/editing.h"
+
 
 namespace MR {
   namespace DWI {
@@ -40,8 +45,9 @@ namespace MR {
 
           public:
 
-            Receiver (const std::string& path, const Properties& properties, const size_t n, const size_t s) :
-              writer (path, properties),
+            Receiver (const std::string& path, const Properties& properties, const size_t n, const size_t s,
+                      const size_t buffer_capacity = 16777216, const bool display = true) :
+              writer (path, properties, buffer_capacity),
               number (n),
               skip (s),
               // Need to use local counts instead of writer class members due to track cropping
@@ -49,7 +55,9 @@ namespace MR {
               total_count (0),
               crop (properties.mask.size()),
               segments (0),
-              progress (std::string("       0 read,        0 written") + (crop ? ",        0 segments" : "")) { }
+              progress (display ?
+                        ProgressBar (std::string("       0 read,        0 written") + (crop ? ",        0 segments" : "")) :
+                        ProgressBar()) { }
 
             ~Receiver()
             {
@@ -62,6 +70,8 @@ namespace MR {
 
             bool operator() (const Streamline<>&);
 
+            uint64_t written () const { return count; }
+
 
           private:
 
@@ -77,6 +87,38 @@ namespace MR {
 
 
 
+
+        // Writes each of the outputs of BundleWorker to its own file
+        class BundleReceiver
+        { MEMALIGN(BundleReceiver)
+
+          public:
+
+            BundleReceiver (const std::string& path, const Properties& properties, const vector<Bundle>& bundles, const ROISet& rois, const size_t n, const size_t s);
+
+            ~BundleReceiver()
+            {
+              progress.set_text (display_text());
+            }
+
+
+            bool operator() (const vector<Streamline<>>&);
+
+
+          private:
+
+            vector<std::unique_ptr<Receiver>> receivers;
+            vector<bool> active;
+            size_t num_active;
+            uint64_t total_count;
+            ProgressBar progress;
+
+            std::string display_text () const;
+
+        };
+
+
+
       }
     }
   }
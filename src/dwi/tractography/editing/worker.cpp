@@ -31,13 +31,31 @@ namespace MR {
           out.index = in.index;
           out.weight = in.weight;
 
-          if (!thresholds (in)) {
-            // Want to test thresholds before wasting time on resampling
+          if (!accept (in)) {
             if (inverse)
               in.swap (out);
             return true;
           }
 
+          if (properties.mask.size()) {
+            crop (in, properties.mask, inverse, out);
+            return true;
+          }
+
+          if (!inverse)
+            in.swap (out);
+          return true;
+
+        }
+
+
+
+        bool Worker::accept (const Streamline<>& in) const
+        {
+          // Want to test thresholds before wasting time on resampling
+          if (!thresholds (in))
+            return false;
+
           // Assign to ROIs
           if (properties.include.size() || properties.exclude.size()) {
 
@@ -47,78 +65,120 @@ namespace MR {
               for (size_t i = 0; i != 2; ++i) {
                 const Eigen::Vector3f& p (i ? in.back() : in.front());
                 properties.include.contains (p, include_visited);
-                if (properties.exclude.contains (p)) {
-                  if (inverse)
-                    in.swap (out);
-                  return true;
-                }
+                if (properties.exclude.contains (p))
+                  return false;
               }
             } else {
-              for (const auto& p : in) {
-                properties.include.contains (p, include_visited);
-                if (properties.exclude.contains (p)) {
-                  if (inverse)
-                    in.swap (out);
-                  return true;
-                }
-              }
+              if (properties.exclude.contains (in))
+                return false;
+              properties.include.contains (in, include_visited);
             }
 
             // Make sure all of the include regions were visited
             for (const auto& i : include_visited) {
-              if (!i) {
-                if (inverse)
-                  in.swap (out);
-                return true;
-              }
+              if (!i)
+                return false;
             }
 
           }
 
-          if (properties.mask.size()) {
+          return true;
+        }
 
-            // Split tck into separate tracks based on the mask
-            vector<vector<Eigen::Vector3f>> cropped_tracks;
-            vector<Eigen::Vector3f> temp;
-
-            for (const auto& p : in) {
-              const bool contains = properties.mask.contains (p);
-              if (contains == inverse) {
-                if (temp.size() >= 2)
-                  cropped_tracks.push_back (temp);
-                temp.clear();
-              } else {
-                temp.push_back (p);
-              }
-            }
-            if (temp.size() >= 2)
-              cropped_tracks.push_back (temp);
 
-            if (cropped_tracks.empty())
-              return true;
 
-            if (cropped_tracks.size() == 1) {
-              cropped_tracks[0].swap (out);
-              return true;
+        void Worker::crop (const Streamline<>& in, const ROISet& mask, const bool inverse, Streamline<>& out)
+        {
+          // Split tck into separate tracks based on the mask
+          vector<vector<Eigen::Vector3f>> cropped_tracks;
+          vector<Eigen::Vector3f> temp;
+
+          for (const auto& p : in) {
+            const bool contains = mask.contains (p);
+            if (contains == inverse) {
+              if (temp.size() >= 2)
+                cropped_tracks.push_back (temp);
+              temp.clear();
+            } else {
+              temp.push_back (p);
             }
+          }
+          if (temp.size() >= 2)
+            cropped_tracks.push_back (temp);
 
-            // Stitch back together in preparation for sending down queue as a single track
+          if (cropped_tracks.empty())
+            return;
+
+          if (cropped_tracks.size() == 1) {
+            cropped_tracks[0].swap (out);
+            return;
+          }
+
+          // Stitch back together in preparation for sending down queue as a single track
+          out.push_back ({ NaN, NaN, NaN });
+          for (const auto& i : cropped_tracks) {
+            for (const auto& p : i)
+              out.push_back (p);
             out.push_back ({ NaN, NaN, NaN });
-            for (const auto& i : cropped_tracks) {
-              for (const auto& p : i)
-                out.push_back (p);
-              out.push_back ({ NaN, NaN, NaN });
-            }
+          }
+        }
+
+
+
+
+
+
+
+
+
+        bool BundleWorker::operator() (Streamline<>& in, vector<Streamline<>>& out) const
+        {
+          out.resize (bundles.size() + 1);
+          for (auto& i : out) {
+            i.clear();
+            i.index = in.index;
+            i.weight = in.weight;
+          }
+
+          if (!common.accept (in))
             return true;
 
+          // A single pass through the streamline tests it against the ROIs of all bundles
+          roi_visited.assign (rois.size(), false);
+          if (ends_only) {
+            if (in.empty())
+              return true;
+            rois.contains (in.front(), roi_visited);
+            rois.contains (in.back(), roi_visited);
           } else {
+            rois.contains (in, roi_visited);
+          }
 
-            if (!inverse)
-              in.swap (out);
-            return true;
+          bool assigned = false;
+          for (size_t b = 0; b != bundles.size(); ++b) {
+            const Bundle& bundle (bundles[b]);
+            bool accept = true;
+            for (auto i : bundle.include)
+              accept = accept && roi_visited[i];
+            for (auto i : bundle.exclude)
+              accept = accept && !roi_visited[i];
+            if (!accept)
+              continue;
+            assigned = true;
+            if (bundle.mask.size())
+              Worker::crop (in, bundle.mask, false, out[b+1]);
+            else
+              out[b+1] = in;
+          }
 
+          if (!assigned) {
+            if (properties.mask.size())
+              Worker::crop (in, properties.mask, false, out[0]);
+            else
+              in.swap (out[0]);
           }
 
+          return true;
         }
 
 
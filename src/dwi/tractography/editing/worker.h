@@ -22,8 +22,11 @@
 #include "types.h"
 
 #include "dwi/tractography/properties.h"
+#include "dwi/tractography/roi.h"
 #include "dwi/tractography/streamline.h"
 
+#include "dwi/tractography/editing/editing.h"
+
 
 
 namespace MR {
@@ -55,6 +58,14 @@ namespace MR {
 
             bool operator() (Streamline<>&, Streamline<>&) const;
 
+            //! whether a streamline satisfies the length / weight thresholds and include / exclude ROIs
+            bool accept (const Streamline<>&) const;
+
+            //! split a streamline into the segments within (or, if inverse, outside) a set of mask ROIs
+            /*! multiple segments are delimited by non-finite points; if there are
+             * no segments of at least two points, \a out is left empty */
+            static void crop (const Streamline<>& in, const ROISet& mask, const bool inverse, Streamline<>& out);
+
 
           private:
             const Tractography::Properties& properties;
@@ -79,6 +90,49 @@ namespace MR {
 
 
 
+        // Assigns each streamline to any number of bundles in a single pass
+        //   through the data; element n+1 of the output receives the streamline
+        //   (cropped to the bundle mask if applicable) if it is assigned to
+        //   bundle n, whereas element 0 receives it only if it satisfies the
+        //   common criteria but is assigned to no bundle
+        class BundleWorker
+        { MEMALIGN(BundleWorker)
+
+          public:
+            BundleWorker (Tractography::Properties& p, const vector<Bundle>& b, const ROISet& r, const bool end) :
+              properties (p),
+              bundles (b),
+              rois (r),
+              ends_only (end),
+              common (p, false, end),
+              roi_visited (rois.size(), false) { }
+
+            BundleWorker (const BundleWorker& that) :
+              properties (that.properties),
+              bundles (that.bundles),
+              rois (that.rois),
+              ends_only (that.ends_only),
+              common (that.common),
+              roi_visited (rois.size(), false) { }
+
+
+            bool operator() (Streamline<>&, vector<Streamline<>>&) const;
+
+
+          private:
+            const Tractography::Properties& properties;
+            const vector<Bundle>& bundles;
+            const ROISet& rois;
+            const bool ends_only;
+            const Worker common;
+
+            mutable vector<bool> roi_visited;
+
+        };
+
+
+
+
       }
     }
   }
@@ -25,6 +25,7 @@
 #include "file/key_value.h"
 #include "file/ofstream.h"
 #include "dwi/tractography/file_base.h"
+#include "dwi/tractography/file_compressed.h"
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/streamline.h"
 
@@ -44,25 +45,6 @@ namespace MR
             "with the option -nthreads 0.";
 
 
-      template <class ValueType>
-      class ReaderInterface
-      { NOMEMALIGN
-        public:
-          virtual bool operator() (Streamline<ValueType>&) = 0;
-          virtual ~ReaderInterface() { }
-      };
-
-
-      template <class ValueType>
-      class WriterInterface
-      { NOMEMALIGN
-        public:
-          virtual bool operator() (const Streamline<ValueType>&) = 0;
-          virtual ~WriterInterface() { }
-      };
-
-
-
       //! A class to read streamlines data
       template <class ValueType = float>
       class Reader : public __ReaderBase__, public ReaderInterface<ValueType>
@@ -70,9 +52,14 @@ namespace MR
         public:
 
           //! open the \c file for reading and load header into \c properties
+          /*! Compressed track files (with the .tcz suffix) are also
+           * supported, with decoding deferred to the CompressedReader class. */
           Reader (const std::string& file, Properties& properties) :
             current_index (0) {
-              open (file, "tracks", properties);
+              if (Path::has_suffix (file, ".tcz"))
+                compressed.reset (new CompressedReader<ValueType> (file, properties));
+              else
+                open (file, "tracks", properties);
               auto opt = App::get_options ("tck_weights_in");
               if (opt.size()) {
                 weights_file.reset (new std::ifstream (str(opt[0][0]).c_str(), std::ios_base::in));
@@ -86,6 +73,14 @@ namespace MR
             bool operator() (Streamline<ValueType>& tck) {
               tck.clear();
 
+              if (compressed) {
+                if ((*compressed) (tck))
+                  return assign_index_and_weight (tck);
+                compressed.reset();
+                check_excess_weights();
+                return false;
+              }
+
               if (!in.is_open())
                 return false;
 
@@ -102,25 +97,8 @@ namespace MR
                   return false;
                 }
 
-                if (std::isnan (p[0])) {
-                  tck.index = current_index++;
-
-                  if (weights_file) {
-
-                    (*weights_file) >> tck.weight;
-                    if (weights_file->fail()) {
-                      WARN ("Streamline weights file contains less entries than .tck file; only read " + str(current_index-1) + " streamlines");
-                      in.close();
-                      tck.clear();
-                      return false;
-                    }
-
-                  } else {
-                    tck.weight = 1.0;
-                  }
-
-                  return true;
-                }
+                if (std::isnan (p[0]))
+                  return assign_index_and_weight (tck);
 
                 tck.push_back (p);
               } while (in.good());
@@ -137,6 +115,30 @@ namespace MR
 
           uint64_t current_index;
           std::unique_ptr<std::ifstream> weights_file;
+          std::unique_ptr<CompressedReader<ValueType>> compressed;
+
+          //! set the index of a fully-read track, and its weight if a weights file is provided
+          bool assign_index_and_weight (Streamline<ValueType>& tck)
+          {
+            tck.index = current_index++;
+
+            if (weights_file) {
+
+              (*weights_file) >> tck.weight;
+              if (weights_file->fail()) {
+                WARN ("Streamline weights file contains less entries than track file; only read " + str(current_index-1) + " streamlines");
+                in.close();
+                compressed.reset();
+                tck.clear();
+                return false;
+              }
+
+            } else {
+              tck.weight = 1.0;
+            }
+
+            return true;
+          }
 
           //! takes care of byte ordering issues
 
@@ -183,7 +185,7 @@ namespace MR
             float temp;
             (*weights_file) >> temp;
             if (!weights_file->fail())
-              WARN ("Streamline weights file contains more entries than .tck file");
+              WARN ("Streamline weights file contains more entries than track file");
           }
 
           Reader (const Reader&) = delete;
@@ -74,6 +74,7 @@ namespace MR {
         else
           fname = file;
 
+        data_path = fname;
         in.open (fname.c_str(), std::ios::in | std::ios::binary);
         if (!in)
           throw Exception ("error opening " + type  + " data file \"" + fname + "\": " + strerror(errno));
@@ -24,6 +24,7 @@
 #include "file/ofstream.h"
 #include "file/path.h"
 #include "dwi/tractography/properties.h"
+#include "dwi/tractography/streamline.h"
 
 
 
@@ -35,6 +36,25 @@ namespace MR
     namespace Tractography
     {
 
+      template <class ValueType>
+      class ReaderInterface
+      { NOMEMALIGN
+        public:
+          virtual bool operator() (Streamline<ValueType>&) = 0;
+          virtual ~ReaderInterface() { }
+      };
+
+
+      template <class ValueType>
+      class WriterInterface
+      { NOMEMALIGN
+        public:
+          virtual bool operator() (const Streamline<ValueType>&) = 0;
+          virtual ~WriterInterface() { }
+      };
+
+
+
       //! \cond skip
       class __ReaderBase__
       { NOMEMALIGN
@@ -48,10 +68,14 @@ namespace MR
 
           void close () { in.close(); }
 
+          //! the path of the file containing the binary track data
+          const std::string& get_data_path () const { return data_path; }
+
         protected:
 
           std::ifstream  in;
           DataType  dtype;
+          std::string data_path;
       };
 
 
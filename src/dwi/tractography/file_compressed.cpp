@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#include "dwi/tractography/file_compressed.h"
+
+#include <zlib.h>
+
+#include "raw.h"
+
+namespace MR {
+  namespace DWI {
+    namespace Tractography {
+      namespace Compressed {
+
+
+
+        void write_block (File::OFStream& out, const std::string& raw, const uint32_t count)
+        {
+          uLongf compressed_size = compressBound (raw.size());
+          std::unique_ptr<uint8_t[]> data (new uint8_t [block_header_size + compressed_size]);
+          if (compress2 (data.get() + block_header_size, &compressed_size,
+                         reinterpret_cast<const Bytef*> (raw.data()), raw.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+            throw Exception ("error compressing streamline data");
+          Raw::store_LE<uint32_t> (compressed_size, data.get(), 0);
+          Raw::store_LE<uint32_t> (raw.size(), data.get(), 1);
+          Raw::store_LE<uint32_t> (count, data.get(), 2);
+          out.write (reinterpret_cast<const char*> (data.get()), block_header_size + compressed_size);
+        }
+
+
+
+        uint32_t read_block (std::istream& in, const int64_t offset, std::string& raw)
+        {
+          uint32_t header[3];
+          in.seekg (offset);
+          in.read (reinterpret_cast<char*> (header), block_header_size);
+          const uint32_t compressed_size = Raw::fetch_LE<uint32_t> (header, 0);
+          uLongf raw_size = Raw::fetch_LE<uint32_t> (header, 1);
+          const uint32_t count = Raw::fetch_LE<uint32_t> (header, 2);
+          std::unique_ptr<uint8_t[]> data (new uint8_t [compressed_size]);
+          in.read (reinterpret_cast<char*> (data.get()), compressed_size);
+          if (!in.good())
+            throw Exception ("error reading block of compressed track file");
+          raw.resize (raw_size);
+          if (uncompress (reinterpret_cast<Bytef*> (&raw[0]), &raw_size, data.get(), compressed_size) != Z_OK || raw_size != raw.size())
+            throw Exception ("error decompressing block of compressed track file");
+          return count;
+        }
+
+
+
+        void write_index (File::OFStream& out, const vector<Block>& index)
+        {
+          const int64_t index_offset = out.tellp();
+          for (const auto& block : index) {
+            alignas(uint64_t) uint8_t entry[index_entry_size];
+            Raw::store_LE<uint64_t> (block.offset, entry);
+            Raw::store_LE<uint32_t> (block.count, entry + sizeof(uint64_t));
+            out.write (reinterpret_cast<const char*> (entry), index_entry_size);
+          }
+          uint64_t trailer[2];
+          Raw::store_LE<uint64_t> (index_offset, trailer, 0);
+          Raw::store_LE<uint64_t> (index.size(), trailer, 1);
+          out.write (reinterpret_cast<const char*> (trailer), trailer_size);
+        }
+
+
+
+        vector<Block> read_index (std::istream& in, const std::string& name)
+        {
+          const int64_t data_offset = in.tellg();
+          in.seekg (0, std::ios::end);
+          const int64_t file_size = in.tellg();
+          if (file_size < data_offset + int64_t(trailer_size))
+            throw Exception ("compressed track file \"" + name + "\" is incomplete");
+
+          uint64_t trailer[2];
+          in.seekg (file_size - trailer_size);
+          in.read (reinterpret_cast<char*> (trailer), trailer_size);
+          const int64_t index_offset = Raw::fetch_LE<uint64_t> (trailer, 0);
+          const uint64_t num_blocks = Raw::fetch_LE<uint64_t> (trailer, 1);
+          if (index_offset < data_offset || index_offset + int64_t(num_blocks * index_entry_size + trailer_size) != file_size)
+            throw Exception ("compressed track file \"" + name + "\" is incomplete or corrupt");
+
+          vector<Block> index (num_blocks);
+          in.seekg (index_offset);
+          for (auto& block : index) {
+            alignas(uint64_t) uint8_t entry[index_entry_size];
+            in.read (reinterpret_cast<char*> (entry), index_entry_size);
+            block.offset = Raw::fetch_LE<uint64_t> (entry);
+            block.count = Raw::fetch_LE<uint32_t> (entry + sizeof(uint64_t));
+          }
+          if (!in.good())
+            throw Exception ("error reading index of compressed track file \"" + name + "\"");
+          return index;
+        }
+
+
+
+      }
+    }
+  }
+}
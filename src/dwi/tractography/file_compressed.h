@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#ifndef __dwi_tractography_file_compressed_h__
+#define __dwi_tractography_file_compressed_h__
+
+#include <cmath>
+#include <string>
+
+#include "app.h"
+#include "types.h"
+#include "file/ofstream.h"
+#include "file/path.h"
+#include "dwi/tractography/file_base.h"
+#include "dwi/tractography/properties.h"
+#include "dwi/tractography/streamline.h"
+
+
+// Default spacing (in mm) of the fixed-point grid onto which streamline
+//   vertex positions are quantised when writing compressed track files
+#define TRACK_COMPRESSED_DEFAULT_QUANTISATION 0.01
+
+// Amount of encoded streamline data (in bytes) to accumulate before
+//   compressing it as an independent block
+#define TRACK_COMPRESSED_BLOCK_SIZE 1048576
+
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+
+
+      //! Encoding of streamline data within compressed track files (.tcz)
+      /*! Each streamline is stored as its number of vertices, followed by the
+       * difference between the quantised position of each vertex and that of
+       * the preceding vertex (the first vertex relative to the origin); all
+       * values are stored as variable-length integers, with signed values
+       * zig-zag encoded. Streamlines are grouped into blocks, each of which is
+       * compressed independently using zlib; a block consists of a 12-byte
+       * header (compressed size, decoded size, number of streamlines; each as
+       * little-endian uint32), followed by the compressed data. An index of
+       * all blocks (file offset as uint64, number of streamlines as uint32,
+       * both little-endian) follows the last block, and the file concludes
+       * with the file offset of that index and the number of blocks (both
+       * little-endian uint64). */
+      namespace Compressed
+      {
+
+        class Block
+        { NOMEMALIGN
+          public:
+            int64_t offset;
+            uint32_t count;
+        };
+
+        constexpr size_t block_header_size = 3 * sizeof(uint32_t);
+        constexpr size_t index_entry_size = sizeof(uint64_t) + sizeof(uint32_t);
+        constexpr size_t trailer_size = 2 * sizeof(uint64_t);
+
+
+
+        inline void encode (std::string& buffer, uint64_t value)
+        {
+          while (value >= 0x80) {
+            buffer.push_back (char (uint8_t (value) | 0x80));
+            value >>= 7;
+          }
+          buffer.push_back (char (value));
+        }
+
+        inline void encode_signed (std::string& buffer, const int64_t value)
+        {
+          encode (buffer, (uint64_t(value) << 1) ^ uint64_t(value >> 63));
+        }
+
+        inline uint64_t decode (const std::string& buffer, size_t& pos)
+        {
+          uint64_t value = 0;
+          for (size_t shift = 0; pos < buffer.size() && shift < 64; shift += 7) {
+            const uint8_t byte = buffer[pos++];
+            value |= uint64_t (byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+              return value;
+          }
+          throw Exception ("malformed streamline data in compressed track file");
+        }
+
+        inline int64_t decode_signed (const std::string& buffer, size_t& pos)
+        {
+          const uint64_t value = decode (buffer, pos);
+          return int64_t (value >> 1) ^ -int64_t (value & 1);
+        }
+
+
+
+        //! decode the streamline starting at position \a pos within \a raw
+        template <typename ValueType>
+        void decode (const std::string& raw, size_t& pos, const default_type quantisation, Streamline<ValueType>& tck)
+        {
+          using point_type = typename Streamline<ValueType>::point_type;
+          const size_t num_points = decode (raw, pos);
+          int64_t q[3] = { 0, 0, 0 };
+          tck.reserve (num_points);
+          for (size_t n = 0; n != num_points; ++n) {
+            for (size_t axis = 0; axis != 3; ++axis)
+              q[axis] += decode_signed (raw, pos);
+            tck.push_back (point_type (ValueType (q[0] * quantisation),
+                                       ValueType (q[1] * quantisation),
+                                       ValueType (q[2] * quantisation)));
+          }
+        }
+
+
+
+        //! compress the encoded streamline data in \a raw, and write the resulting block to \a out
+        void write_block (File::OFStream& out, const std::string& raw, const uint32_t count);
+
+        //! read the block at \a offset from \a in, and decompress its encoded streamline data into \a raw
+        /*! Returns the number of streamlines contained within the block.
+         * Since only the stream provided is modified, multiple blocks can be
+         * read and decoded concurrently using separate streams. */
+        uint32_t read_block (std::istream& in, const int64_t offset, std::string& raw);
+
+        //! write the block index and file trailer to \a out
+        void write_index (File::OFStream& out, const vector<Block>& index);
+
+        //! read the block index from the end of \a in
+        vector<Block> read_index (std::istream& in, const std::string& name);
+
+      }
+
+
+
+
+      //! A class to read streamlines data from compressed track files (.tcz)
+      /*! This class will typically not be used directly: the Reader class
+       * will defer to it for any input file with the .tcz suffix, such that
+       * compressed track files are supported wherever track files can be
+       * read. */
+      template <class ValueType = float>
+      class CompressedReader : public __ReaderBase__
+      { NOMEMALIGN
+        public:
+          //! open the \c file for reading and load header into \c properties
+          CompressedReader (const std::string& file, Properties& properties) :
+              quantisation (NaN),
+              next_block (0),
+              pos (0),
+              remaining (0)
+          {
+            open (file, "compressed tracks", properties);
+            auto it = properties.find ("quantisation");
+            if (it != properties.end())
+              quantisation = to<default_type> (it->second);
+            if (!(quantisation > 0.0))
+              throw Exception ("invalid or missing quantisation in compressed track file \"" + file + "\"");
+            index = Compressed::read_index (in, file);
+          }
+
+
+          //! fetch next track from file
+          bool operator() (Streamline<ValueType>& tck)
+          {
+            tck.clear();
+            if (!in.is_open())
+              return false;
+
+            while (!remaining) {
+              if (next_block == index.size()) {
+                in.close();
+                return false;
+              }
+              remaining = Compressed::read_block (in, index[next_block].offset, raw);
+              if (remaining != index[next_block].count)
+                throw Exception ("mismatch between block header and index in compressed track file");
+              ++next_block;
+              pos = 0;
+            }
+
+            Compressed::decode (raw, pos, quantisation, tck);
+            --remaining;
+            return true;
+          }
+
+
+          //! the spacing of the grid onto which vertex positions have been quantised
+          default_type get_quantisation() const { return quantisation; }
+
+          //! the file offsets & streamline counts of all blocks within the file
+          const vector<Compressed::Block>& get_index() const { return index; }
+
+
+        protected:
+          using __ReaderBase__::in;
+
+          default_type quantisation;
+          vector<Compressed::Block> index;
+          size_t next_block;
+          std::string raw;
+          size_t pos;
+          uint32_t remaining;
+
+          CompressedReader (const CompressedReader&) = delete;
+
+      };
+
+
+
+
+
+
+      //! class to handle writing tracks to compressed track files (.tcz)
+      /*! Vertex positions are quantised onto a grid with spacing \a
+       * quantisation (in mm), and hence may differ from the input by up to
+       * half that amount along each axis; no error accumulates along the
+       * length of the streamline. Encoded streamlines are held in RAM until
+       * TRACK_COMPRESSED_BLOCK_SIZE bytes have accrued, at which point they
+       * are compressed and written to file as a single block. */
+      template <typename ValueType = float>
+        class CompressedWriter : public __WriterBase__<ValueType>, public WriterInterface<ValueType>
+      { NOMEMALIGN
+        public:
+          using __WriterBase__<ValueType>::count;
+          using __WriterBase__<ValueType>::total_count;
+          using __WriterBase__<ValueType>::name;
+          using __WriterBase__<ValueType>::create;
+          using __WriterBase__<ValueType>::verify_stream;
+          using __WriterBase__<ValueType>::update_counts;
+          using __WriterBase__<ValueType>::open_success;
+
+          //! create a new compressed track file with the specified properties
+          CompressedWriter (const std::string& file, const Properties& properties, const default_type quantisation = TRACK_COMPRESSED_DEFAULT_QUANTISATION) :
+              __WriterBase__<ValueType> (file),
+              quantisation (quantisation),
+              buffer_count (0)
+          {
+            if (!Path::has_suffix (name, ".tcz"))
+              throw Exception ("compressed track files must use the .tcz suffix");
+            if (!(quantisation > 0.0))
+              throw Exception ("quantisation of compressed track file must be positive");
+
+            File::OFStream out;
+            try {
+              out.open (name, std::ios::out | std::ios::binary | std::ios::trunc);
+            } catch (Exception& e) {
+              throw Exception (e, "Unable to create output track file");
+            }
+
+            const_cast<Properties&> (properties).set_timestamp();
+            const_cast<Properties&> (properties).set_version_info();
+            const_cast<Properties&> (properties)["quantisation"] = str(quantisation);
+
+            create (out, properties, "compressed tracks");
+            data_end = out.tellp();
+            verify_stream (out);
+            open_success = true;
+          }
+
+          CompressedWriter (const CompressedWriter&) = delete;
+
+          //! commits any remaining data, and writes the block index
+          ~CompressedWriter()
+          {
+            if (!open_success)
+              return;
+            commit();
+            File::OFStream out (name, std::ios::in | std::ios::out | std::ios::binary);
+            out.seekp (data_end);
+            Compressed::write_index (out, index);
+            verify_stream (out);
+          }
+
+          //! append track to file
+          bool operator() (const Streamline<ValueType>& tck)
+          {
+            Compressed::encode (buffer, tck.size());
+            int64_t prev[3] = { 0, 0, 0 };
+            for (const auto& p : tck) {
+              assert (p.allFinite());
+              for (size_t axis = 0; axis != 3; ++axis) {
+                const int64_t q = std::llround (p[axis] / quantisation);
+                Compressed::encode_signed (buffer, q - prev[axis]);
+                prev[axis] = q;
+              }
+            }
+            ++buffer_count;
+            ++count;
+            ++total_count;
+            if (buffer.size() >= TRACK_COMPRESSED_BLOCK_SIZE)
+              commit();
+            return true;
+          }
+
+
+        protected:
+          const default_type quantisation;
+          std::string buffer;
+          uint32_t buffer_count;
+          int64_t data_end;
+          vector<Compressed::Block> index;
+
+          void commit ()
+          {
+            if (!buffer_count)
+              return;
+            File::OFStream out (name, std::ios::in | std::ios::out | std::ios::binary);
+            out.seekp (data_end);
+            Compressed::write_block (out, buffer, buffer_count);
+            verify_stream (out);
+            index.push_back ({ data_end, buffer_count });
+            data_end = out.tellp();
+            update_counts (out);
+            buffer.clear();
+            buffer_count = 0;
+          }
+
+      };
+
+
+
+    }
+  }
+}
+
+
+#endif
+
@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#ifndef __dwi_tractography_file_sharded_h__
+#define __dwi_tractography_file_sharded_h__
+
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#include "raw.h"
+#include "thread.h"
+#include "types.h"
+#include "dwi/tractography/file.h"
+#include "dwi/tractography/file_compressed.h"
+#include "dwi/tractography/streamline.h"
+
+
+// Amount of track data (in bytes) from a .tck file to be decoded by a
+//   single thread at a time
+#define TRACK_SHARD_SIZE 4194304
+
+// Maximal number of shards per decoding thread that may be decoded ahead of
+//   the shard currently being provided by the reader
+#define TRACK_SHARDS_PER_THREAD 4
+
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+
+
+
+      //! A class to read streamlines data, decoding the file concurrently in multiple threads
+      /*! This class is a drop-in replacement for the Reader class, intended
+       * for use as the source stage of a Thread::run_queue() pipeline where
+       * the single thread reading the track file would otherwise be the
+       * bottleneck.
+       *
+       * The binary data are split into shards: contiguous byte ranges for .tck
+       * files, or individual blocks for compressed .tcz files. Each of \a
+       * num_threads decoding threads claims the next available shard; for .tck
+       * files, it re-synchronises to the first streamline commencing within its
+       * range, and decodes all streamlines commencing within that range (even
+       * if they extend beyond it). The decoded shards are then provided by
+       * operator() in their original order, such that streamline indices and
+       * weights (if provided via the -tck_weights_in option) are identical to
+       * those yielded by the Reader class. */
+      template <class ValueType = float>
+      class ShardedReader : public Reader<ValueType>
+      { NOMEMALIGN
+        public:
+
+          //! open the \c file for reading and load header into \c properties
+          ShardedReader (const std::string& file, Properties& properties, const size_t num_threads = Thread::number_of_threads()) :
+              Reader<ValueType> (file, properties),
+              shared (*this, num_threads),
+              decoder (shared),
+              pos (0),
+              finished (false)
+          {
+            if (num_threads)
+              threads.reset (new threads_type (Thread::run (Thread::multi (decoder, num_threads), "track decoding threads")));
+          }
+
+          ~ShardedReader ()
+          {
+            shared.stop();
+          }
+
+
+          //! fetch next track from file
+          bool operator() (Streamline<ValueType>& tck) override
+          {
+            tck.clear();
+            if (finished)
+              return false;
+
+            while (pos == current.tracks.size()) {
+              if (!(threads ? shared.fetch (current) : shared.decode_next (current))) {
+                finished = true;
+                check_excess_weights();
+                return false;
+              }
+              pos = 0;
+            }
+
+            tck = std::move (current.tracks[pos++]);
+            if (!assign_index_and_weight (tck)) {
+              finished = true;
+              return false;
+            }
+            return true;
+          }
+
+
+        protected:
+          using Reader<ValueType>::check_excess_weights;
+          using Reader<ValueType>::assign_index_and_weight;
+          using point_type = typename Streamline<ValueType>::point_type;
+
+
+          class Shard
+          { NOMEMALIGN
+            public:
+              Shard () : end (false) { }
+              vector<Streamline<ValueType>> tracks;
+              // Set if the end of the track data was encountered
+              bool end;
+          };
+
+
+          class Shared
+          { NOMEMALIGN
+            public:
+              Shared (ShardedReader& reader, const size_t num_threads) :
+                  path (reader.compressed ? reader.compressed->get_data_path() : reader.get_data_path()),
+                  is_compressed (bool (reader.compressed)),
+                  dtype (reader.dtype),
+                  quantisation (reader.compressed ? reader.compressed->get_quantisation() : NaN),
+                  window (TRACK_SHARDS_PER_THREAD * std::max (num_threads, size_t(1))),
+                  next_shard (0),
+                  next_output (0),
+                  stopped (false)
+              {
+                if (is_compressed) {
+                  blocks = reader.compressed->get_index();
+                  num_shards = blocks.size();
+                } else {
+                  data_offset = reader.in.tellg();
+                  std::ifstream in (path, std::ios::in | std::ios::binary | std::ios::ate);
+                  point_bytes = 3 * dtype.bytes();
+                  num_points = (int64_t (in.tellg()) - data_offset) / point_bytes;
+                  shard_points = std::max (int64_t (1), int64_t (TRACK_SHARD_SIZE / point_bytes));
+                  num_shards = (num_points + shard_points - 1) / shard_points;
+                }
+              }
+
+              //! claim the next shard to be decoded by a decoding thread
+              bool claim (size_t& index)
+              {
+                std::unique_lock<std::mutex> lock (mutex);
+                claimable.wait (lock, [&] { return stopped || next_shard >= num_shards || next_shard < next_output + window; });
+                if (stopped || next_shard >= num_shards)
+                  return false;
+                index = next_shard++;
+                return true;
+              }
+
+              //! provide a shard decoded by a decoding thread
+              void deliver (const size_t index, Shard& shard)
+              {
+                {
+                  std::lock_guard<std::mutex> lock (mutex);
+                  // No further shards should be decoded if the end of the data has been encountered
+                  if (shard.end)
+                    num_shards = std::min (num_shards, index+1);
+                  decoded.insert (std::make_pair (index, std::move (shard)));
+                }
+                available.notify_all();
+              }
+
+              //! terminate all decoding threads due to an error
+              void fail (const Exception& e)
+              {
+                {
+                  std::lock_guard<std::mutex> lock (mutex);
+                  error.reset (new Exception (e));
+                  stopped = true;
+                }
+                claimable.notify_all();
+                available.notify_all();
+              }
+
+              //! terminate all decoding threads
+              void stop ()
+              {
+                {
+                  std::lock_guard<std::mutex> lock (mutex);
+                  stopped = true;
+                }
+                claimable.notify_all();
+              }
+
+              //! obtain the next shard in order from the decoding threads
+              bool fetch (Shard& shard)
+              {
+                {
+                  std::unique_lock<std::mutex> lock (mutex);
+                  available.wait (lock, [&] { return error || next_output >= num_shards || decoded.count (next_output); });
+                  if (error)
+                    throw *error;
+                  if (next_output >= num_shards)
+                    return false;
+                  auto it = decoded.find (next_output);
+                  shard = std::move (it->second);
+                  decoded.erase (it);
+                  ++next_output;
+                }
+                claimable.notify_all();
+                return true;
+              }
+
+              //! decode the next shard in order within the calling thread
+              bool decode_next (Shard& shard)
+              {
+                if (next_output >= num_shards)
+                  return false;
+                if (!in.is_open())
+                  in.open (path, std::ios::in | std::ios::binary);
+                decode (in, next_output, shard);
+                if (shard.end)
+                  num_shards = next_output + 1;
+                ++next_output;
+                return true;
+              }
+
+              void decode (std::ifstream& in, const size_t index, Shard& shard) const
+              {
+                shard.tracks.clear();
+                shard.end = false;
+                if (is_compressed)
+                  decode_block (in, index, shard);
+                else
+                  decode_range (in, index, shard);
+              }
+
+              const std::string path;
+
+            protected:
+              const bool is_compressed;
+              const DataType dtype;
+              const default_type quantisation;
+              const size_t window;
+              vector<Compressed::Block> blocks;
+              int64_t data_offset, point_bytes, num_points, shard_points;
+              size_t num_shards, next_shard, next_output;
+              bool stopped;
+              std::map<size_t, Shard> decoded;
+              std::unique_ptr<Exception> error;
+              std::mutex mutex;
+              std::condition_variable claimable, available;
+              std::ifstream in;
+
+
+              void decode_block (std::ifstream& in, const size_t index, Shard& shard) const
+              {
+                std::string raw;
+                const uint32_t count = Compressed::read_block (in, blocks[index].offset, raw);
+                if (count != blocks[index].count)
+                  throw Exception ("mismatch between block header and index in compressed track file");
+                shard.tracks.resize (count);
+                size_t raw_pos = 0;
+                for (auto& tck : shard.tracks)
+                  Compressed::decode (raw, raw_pos, quantisation, tck);
+              }
+
+
+              // Decode all streamlines commencing within the range of points
+              //   allocated to this shard; a streamline commences at the
+              //   first point of the file, or following a NaN delimiter
+              void decode_range (std::ifstream& in, const size_t index, Shard& shard) const
+              {
+                const int64_t begin = index * shard_points;
+                const int64_t end = std::min (begin + shard_points, num_points);
+                PointBuffer buffer (in, *this, begin ? begin-1 : 0);
+                point_type p;
+
+                int64_t start = 0;
+                if (begin) {
+                  do {
+                    if (!buffer.next (p) || std::isinf (p[0])) {
+                      shard.end = true;
+                      return;
+                    }
+                  } while (!std::isnan (p[0]) && buffer.position() < end);
+                  if (!std::isnan (p[0]))
+                    return;
+                }
+                start = buffer.position();
+
+                Streamline<ValueType> tck;
+                while (start < end) {
+                  if (!buffer.next (p) || std::isinf (p[0])) {
+                    shard.end = true;
+                    return;
+                  }
+                  if (std::isnan (p[0])) {
+                    shard.tracks.push_back (std::move (tck));
+                    tck.clear();
+                    start = buffer.position();
+                  } else {
+                    tck.push_back (p);
+                  }
+                }
+              }
+
+
+              // Reads consecutive points from the binary track data in
+              //   chunks, taking care of byte ordering issues
+              class PointBuffer
+              { NOMEMALIGN
+                public:
+                  PointBuffer (std::ifstream& in, const Shared& S, const int64_t first) :
+                      in (in),
+                      S (S),
+                      chunk_points (std::min (S.shard_points, int64_t (65536))),
+                      data (new char [chunk_points * S.point_bytes]),
+                      next_point (first),
+                      chunk_begin (first),
+                      chunk_end (first) { }
+
+                  bool next (point_type& p)
+                  {
+                    if (next_point == chunk_end && !load())
+                      return false;
+                    const char* const ptr = data.get() + (next_point++ - chunk_begin) * S.point_bytes;
+                    switch (S.dtype()) {
+                      case DataType::Float32LE: p = { ValueType(Raw::fetch_LE<float> (ptr, 0)), ValueType(Raw::fetch_LE<float> (ptr, 1)), ValueType(Raw::fetch_LE<float> (ptr, 2)) }; break;
+                      case DataType::Float32BE: p = { ValueType(Raw::fetch_BE<float> (ptr, 0)), ValueType(Raw::fetch_BE<float> (ptr, 1)), ValueType(Raw::fetch_BE<float> (ptr, 2)) }; break;
+                      case DataType::Float64LE: p = { ValueType(Raw::fetch_LE<double> (ptr, 0)), ValueType(Raw::fetch_LE<double> (ptr, 1)), ValueType(Raw::fetch_LE<double> (ptr, 2)) }; break;
+                      case DataType::Float64BE: p = { ValueType(Raw::fetch_BE<double> (ptr, 0)), ValueType(Raw::fetch_BE<double> (ptr, 1)), ValueType(Raw::fetch_BE<double> (ptr, 2)) }; break;
+                      default: assert (0); break;
+                    }
+                    return true;
+                  }
+
+                  //! the index of the next point to be read
+                  int64_t position () const { return next_point; }
+
+                private:
+                  std::ifstream& in;
+                  const Shared& S;
+                  const int64_t chunk_points;
+                  std::unique_ptr<char[]> data;
+                  int64_t next_point, chunk_begin, chunk_end;
+
+                  bool load ()
+                  {
+                    if (next_point >= S.num_points)
+                      return false;
+                    chunk_begin = next_point;
+                    chunk_end = std::min (chunk_begin + chunk_points, S.num_points);
+                    in.clear();
+                    in.seekg (S.data_offset + chunk_begin * S.point_bytes);
+                    in.read (data.get(), (chunk_end - chunk_begin) * S.point_bytes);
+                    if (!in.good())
+                      throw Exception ("error reading track data from file \"" + S.path + "\"");
+                    return true;
+                  }
+              };
+
+          };
+
+
+          class Decoder
+          { NOMEMALIGN
+            public:
+              Decoder (Shared& shared) : S (shared) { }
+              Decoder (const Decoder& that) : S (that.S) { }
+
+              void execute ()
+              {
+                try {
+                  std::ifstream in (S.path, std::ios::in | std::ios::binary);
+                  if (!in)
+                    throw Exception ("error opening track data file \"" + S.path + "\": " + strerror (errno));
+                  size_t index;
+                  Shard shard;
+                  while (S.claim (index)) {
+                    S.decode (in, index, shard);
+                    S.deliver (index, shard);
+                  }
+                } catch (Exception& e) {
+                  S.fail (e);
+                }
+              }
+
+            private:
+              Shared& S;
+          };
+
+
+          using threads_type = decltype (Thread::run (Thread::multi (std::declval<Decoder&>()), std::string()));
+
+          Shared shared;
+          Decoder decoder;
+          std::unique_ptr<threads_type> threads;
+          Shard current;
+          size_t pos;
+          bool finished;
+
+      };
+
+
+
+    }
+  }
+}
+
+
+#endif
+
@@ -71,6 +71,82 @@ namespace MR {
 
 
 
+      ROIIndex::ROIIndex (const vector<ROI>& rois)
+      {
+        assert (rois.size() < size_t(std::numeric_limits<index_type>::max()));
+
+        // Cells need not be smaller than the voxels of any mask ROI, but the
+        //   total number of cells is capped
+        Eigen::Vector3f lower (Eigen::Vector3f::Constant (std::numeric_limits<float>::infinity()));
+        Eigen::Vector3f upper (-lower);
+        float resolution = std::numeric_limits<float>::infinity();
+        for (const auto& roi : rois) {
+          roi.foreach_bounds ([&] (const Eigen::Vector3f& l, const Eigen::Vector3f& u) {
+            lower = lower.cwiseMin (l);
+            upper = upper.cwiseMax (u);
+          });
+          resolution = std::min (resolution, roi.resolution());
+        }
+        // Pad slightly, so that no boundary can be lost to rounding
+        const Eigen::Vector3f extent = upper - lower;
+        const Eigen::Vector3f padding = Eigen::Vector3f::Constant (1e-4f * std::max (extent.maxCoeff(), 1.0f));
+        lower -= padding;
+        upper += padding;
+        float cell_size = std::cbrt ((upper - lower).prod() / float(ROISET_INDEX_MAX_CELLS));
+        if (std::isfinite (resolution))
+          cell_size = std::max (cell_size, resolution);
+        inv_cell_size = 1.0f / cell_size;
+        origin = lower;
+        for (size_t axis = 0; axis != 3; ++axis)
+          dim[axis] = std::max (size_t(1), size_t (std::ceil ((upper[axis] - lower[axis]) * inv_cell_size)));
+        const size_t num_cells = dim[0] * dim[1] * dim[2];
+
+        // List (cell, ROI) pairs; as ROIs are processed in order, a counting sort
+        //   by cell preserves ascending ROI order within each cell
+        vector<std::pair<index_type, index_type>> pairs;
+        vector<index_type> last_roi (num_cells, std::numeric_limits<index_type>::max());
+        for (index_type n = 0; n != rois.size(); ++n) {
+          rois[n].foreach_bounds ([&] (const Eigen::Vector3f& l, const Eigen::Vector3f& u) {
+            std::array<size_t,3> from, to;
+            for (size_t axis = 0; axis != 3; ++axis) {
+              from[axis] = size_t (std::max (0.0f, std::floor ((l[axis] - padding[axis] - origin[axis]) * inv_cell_size)));
+              to[axis] = std::min (dim[axis]-1, size_t (std::max (0.0f, std::floor ((u[axis] + padding[axis] - origin[axis]) * inv_cell_size))));
+            }
+            for (size_t z = from[2]; z <= to[2]; ++z) {
+              for (size_t y = from[1]; y <= to[1]; ++y) {
+                for (size_t x = from[0]; x <= to[0]; ++x) {
+                  const size_t cell = x + dim[0] * (y + dim[1] * z);
+                  if (last_roi[cell] != n) {
+                    last_roi[cell] = n;
+                    pairs.push_back (std::make_pair (index_type (cell), n));
+                  }
+                }
+              }
+            }
+          });
+        }
+        if (pairs.size() >= size_t(std::numeric_limits<index_type>::max()))
+          throw Exception ("Too many ROIs to construct spatial index");
+
+        offsets.assign (num_cells + 1, 0);
+        for (const auto& p : pairs)
+          ++offsets[p.first + 1];
+        for (size_t cell = 0; cell != num_cells; ++cell)
+          offsets[cell+1] += offsets[cell];
+        candidates.resize (pairs.size());
+        vector<index_type> position (offsets.begin(), offsets.end()-1);
+        for (const auto& p : pairs)
+          candidates[position[p.first]++] = p.second;
+
+        DEBUG ("ROI spatial index: " + str(dim[0]) + "x" + str(dim[1]) + "x" + str(dim[2])
+               + " cells of size " + str(cell_size) + "mm, " + str(candidates.size()) + " entries");
+      }
+
+
+
+
+
+
       Image<bool> Mask::__get_mask (const std::string& name)
       {
         auto data = Image<bool>::open (name);
@@ -16,13 +16,26 @@
 #ifndef __dwi_tractography_roi_h__
 #define __dwi_tractography_roi_h__
 
+#include <array>
+#include <memory>
+#include <mutex>
+
 #include "app.h"
+#include "bitset.h"
 #include "image.h"
-#include "image.h"
+#include "algo/loop.h"
 #include "interp/linear.h"
 #include "math/rng.h"
 
 
+// Minimum number of ROIs in a set for which containment queries are
+//   accelerated using a spatial index, rather than testing each ROI in turn
+#define ROISET_INDEX_MIN_ROIS 4
+
+// Maximum number of grid cells in such an index
+#define ROISET_INDEX_MAX_CELLS (1<<18)
+
+
 namespace MR
 {
   namespace DWI
@@ -54,6 +67,69 @@ namespace MR
 
 
 
+      // Immutable, bit-packed copy of a Mask (which is already cropped to the
+      //   bounding box of the ROI), used for testing whether positions lie within
+      //   the ROI; since no image state needs to be modified, queries are
+      //   thread-safe without any per-query copy
+      class PackedMask { MEMALIGN(PackedMask)
+        public:
+          PackedMask (Mask mask) :
+              mask_name (mask.name()),
+              scanner2voxel (*mask.scanner2voxel),
+              voxel2scanner (*mask.voxel2scanner),
+              dim {{ int (mask.size(0)), int (mask.size(1)), int (mask.size(2)) }},
+              data (dim[0] * dim[1] * dim[2])
+          {
+            for (auto l = Loop (0,3) (mask); l; ++l) {
+              if (mask.value())
+                data[mask.index(0) + dim[0] * (mask.index(1) + dim[1] * mask.index(2))] = true;
+            }
+          }
+
+          const std::string& name () const { return mask_name; }
+
+          bool contains (const Eigen::Vector3f& p) const
+          {
+            const Eigen::Vector3f v = scanner2voxel * p;
+            // Equivalent to rounding to the nearest voxel & testing against the
+            //   image bounds, but also rejects non-finite positions
+            if (!(v[0] > -0.5f && v[1] > -0.5f && v[2] > -0.5f
+                  && v[0] < dim[0]-0.5f && v[1] < dim[1]-0.5f && v[2] < dim[2]-0.5f))
+              return false;
+            return data[int (std::round (v[0])) + dim[0] * (int (std::round (v[1])) + dim[1] * int (std::round (v[2])))];
+          }
+
+          // Invoke functor with the lower & upper corners of the scanner-space
+          //   bounding box of each voxel within the mask
+          template <class Functor>
+          void foreach_voxel_bounds (Functor&& functor) const
+          {
+            const Eigen::Vector3f half_extent = 0.5f * voxel2scanner.linear().cwiseAbs() * Eigen::Vector3f::Ones();
+            size_t i = 0;
+            for (int z = 0; z != dim[2]; ++z) {
+              for (int y = 0; y != dim[1]; ++y) {
+                for (int x = 0; x != dim[0]; ++x, ++i) {
+                  if (data[i]) {
+                    const Eigen::Vector3f centre = voxel2scanner * Eigen::Vector3f (x, y, z);
+                    functor (Eigen::Vector3f (centre - half_extent), Eigen::Vector3f (centre + half_extent));
+                  }
+                }
+              }
+            }
+          }
+
+          float min_voxel_size () const { return voxel2scanner.linear().colwise().norm().minCoeff(); }
+
+        private:
+          const std::string mask_name;
+          const Mask::transform_type scanner2voxel, voxel2scanner;
+          const std::array<int,3> dim;
+          BitSet data;
+      };
+
+
+
+
       class ROI { MEMALIGN(ROI)
         public:
           ROI (const Eigen::Vector3f& sphere_pos, float sphere_radius) :
@@ -74,7 +150,7 @@ namespace MR
             }
             catch (...) { 
               DEBUG ("could not parse spherical ROI specification \"" + spec + "\" - assuming mask image");
-              mask.reset (new Mask (spec));
+              mask.reset (new PackedMask (Mask (spec)));
             }
           }
 
@@ -86,22 +162,41 @@ namespace MR
 
           bool contains (const Eigen::Vector3f& p) const
           {
+            if (mask)
+              return mask->contains (p);
+            return (pos-p).squaredNorm() <= radius2;
+          }
 
+          //! whether any of the points of a streamline (segment) lie within the ROI
+          bool contains_any (const vector<Eigen::Vector3f>& points) const
+          {
             if (mask) {
-              Eigen::Vector3f v = *(mask->scanner2voxel) * p;
-              Mask temp (*mask); // Required for thread-safety
-              temp.index(0) = std::round (v[0]);
-              temp.index(1) = std::round (v[1]);
-              temp.index(2) = std::round (v[2]);
-              if (is_out_of_bounds (temp))
-                return false;
-              return temp.value();
+              for (const auto& p : points) {
+                if (mask->contains (p))
+                  return true;
+              }
+              return false;
             }
+            for (const auto& p : points) {
+              if ((pos-p).squaredNorm() <= radius2)
+                return true;
+            }
+            return false;
+          }
 
-            return (pos-p).squaredNorm() <= radius2;
-
+          //! invoke functor with scanner-space bounding boxes that together cover the ROI
+          template <class Functor>
+          void foreach_bounds (Functor&& functor) const
+          {
+            if (mask)
+              mask->foreach_voxel_bounds (functor);
+            else
+              functor (Eigen::Vector3f (pos.array() - radius), Eigen::Vector3f (pos.array() + radius));
           }
 
+          //! smallest voxel size for mask ROIs; infinite for spheres
+          float resolution () const { return mask ? mask->min_voxel_size() : std::numeric_limits<float>::infinity(); }
+
           friend inline std::ostream& operator<< (std::ostream& stream, const ROI& roi)
           {
             stream << roi.shape() << " (" << roi.parameters() << ")";
@@ -113,7 +208,7 @@ namespace MR
         private:
           Eigen::Vector3f pos;
           float radius, radius2;
-          std::shared_ptr<Mask> mask;
+          std::shared_ptr<const PackedMask> mask;
 
       };
 
@@ -121,26 +216,94 @@ namespace MR
 
 
 
+      // Uniform grid over the scanner-space bounding box of a set of ROIs, in
+      //   which each cell lists those ROIs that may contain points within that
+      //   cell; a single lookup per point therefore yields the (typically very
+      //   few) ROIs against which that point needs to be tested
+      class ROIIndex { MEMALIGN(ROIIndex)
+        public:
+          using index_type = uint32_t;
+
+          ROIIndex (const vector<ROI>&);
+
+          //! the range of candidate ROI indices for a point, in ascending order
+          std::pair<const index_type*, const index_type*> operator() (const Eigen::Vector3f& p) const
+          {
+            const Eigen::Vector3f v = (p - origin) * inv_cell_size;
+            if (!(v[0] >= 0.0f && v[1] >= 0.0f && v[2] >= 0.0f
+                  && v[0] < dim[0] && v[1] < dim[1] && v[2] < dim[2]))
+              return { nullptr, nullptr };
+            const size_t cell = size_t(v[0]) + dim[0] * (size_t(v[1]) + dim[1] * size_t(v[2]));
+            return { candidates.data() + offsets[cell], candidates.data() + offsets[cell+1] };
+          }
+
+        private:
+          Eigen::Vector3f origin;
+          float inv_cell_size;
+          std::array<size_t,3> dim;
+          vector<index_type> offsets, candidates;
+      };
+
+
+
+
       class ROISet { MEMALIGN(ROISet)
         public:
-          ROISet () { }
+          ROISet () : index (new LazyIndex) { }
 
-          void clear () { R.clear(); }
+          void clear () { R.clear(); index.reset (new LazyIndex); }
           size_t size () const { return (R.size()); }
           const ROI& operator[] (size_t i) const { return (R[i]); }
-          void add (const ROI& roi) { R.push_back (roi); }
+          void add (const ROI& roi) { R.push_back (roi); index.reset (new LazyIndex); }
 
           bool contains (const Eigen::Vector3f& p) const {
+            const ROIIndex* I = get_index();
+            if (I) {
+              const auto range = (*I) (p);
+              for (auto n = range.first; n != range.second; ++n)
+                if (R[*n].contains (p)) return true;
+              return false;
+            }
             for (size_t n = 0; n < R.size(); ++n)
               if (R[n].contains (p)) return (true);
             return false;
           }
 
           void contains (const Eigen::Vector3f& p, vector<bool>& retval) const {
+            const ROIIndex* I = get_index();
+            if (I) {
+              const auto range = (*I) (p);
+              for (auto n = range.first; n != range.second; ++n)
+                if (!retval[*n] && R[*n].contains (p)) retval[*n] = true;
+              return;
+            }
             for (size_t n = 0; n < R.size(); ++n)
               if (R[n].contains (p)) retval[n] = true;
           }
 
+          // Test all points of a streamline (segment) at once: these only need
+          //   to be tested against each ROI until one is found within it
+          bool contains (const vector<Eigen::Vector3f>& points) const {
+            if (get_index()) {
+              for (const auto& p : points)
+                if (contains (p)) return true;
+              return false;
+            }
+            for (size_t n = 0; n < R.size(); ++n)
+              if (R[n].contains_any (points)) return true;
+            return false;
+          }
+
+          void contains (const vector<Eigen::Vector3f>& points, vector<bool>& retval) const {
+            if (get_index()) {
+              for (const auto& p : points)
+                contains (p, retval);
+              return;
+            }
+            for (size_t n = 0; n < R.size(); ++n)
+              if (!retval[n] && R[n].contains_any (points)) retval[n] = true;
+          }
+
           friend inline std::ostream& operator<< (std::ostream& stream, const ROISet& R) {
             if (R.R.empty()) return (stream);
             vector<ROI>::const_iterator i = R.R.begin();
@@ -152,6 +315,22 @@ namespace MR
 
         private:
           vector<ROI> R;
+
+          // The index is only constructed on first use, once all ROIs have been
+          //   added; this may occur concurrently from multiple threads
+          class LazyIndex { NOMEMALIGN
+            public:
+              std::once_flag flag;
+              std::unique_ptr<ROIIndex> data;
+          };
+          std::shared_ptr<LazyIndex> index;
+
+          const ROIIndex* get_index () const {
+            if (R.size() < ROISET_INDEX_MIN_ROIS)
+              return nullptr;
+            std::call_once (index->flag, [&] { index->data.reset (new ROIIndex (R)); });
+            return index->data.get();
+          }
       };
 
 
@@ -64,7 +64,13 @@ namespace MR
                 typename Method::Shared shared (diff_path, properties);
                 WriteKernel writer (shared, destination, properties);
                 Exec<Method> tracker (shared);
-                Thread::run_queue (Thread::multi (tracker), Thread::batch (GeneratedTrack(), TRACKING_BATCH_SIZE), writer);
+                // Batching is not possible in reproducible mode: a thread
+                //   waiting for the writer to catch up could otherwise be
+                //   holding the very streamline that the writer requires
+                if (shared.is_reproducible())
+                  Thread::run_queue (Thread::multi (tracker), GeneratedTrack(), writer);
+                else
+                  Thread::run_queue (Thread::multi (tracker), Thread::batch (GeneratedTrack(), TRACKING_BATCH_SIZE), writer);
 
               } else {
 
@@ -186,31 +192,35 @@ namespace MR
               track_included.assign (track_included.size(), false);
               method.dir = { NaN, NaN, NaN };
 
-              if (S.properties.seeds.is_finite()) {
-
-                if (!S.properties.seeds.get_seed (method.pos, method.dir))
+              if (S.is_reproducible()) {
+                uint64_t seed_number;
+                if (!S.reproducible().get_seed ([&] { return get_seed(); }, S.properties.seeds.is_finite(), thread_local_RNG, seed_number))
                   return false;
-                if (!method.check_seed() || !method.init()) {
-                  track_excluded = true;
-                  tck.set_status (GeneratedTrack::status_t::SEED_REJECTED);
-                }
-                return true;
+                tck.set_seed_number (seed_number);
+              } else if (!get_seed()) {
+                return false;
+              }
+
+              if (!method.check_seed() || !method.init()) {
+                track_excluded = true;
+                tck.set_status (GeneratedTrack::status_t::SEED_REJECTED);
+              }
+              return true;
+            }
 
-              } else {
 
-                for (size_t num_attempts = 0; num_attempts != MAX_NUM_SEED_ATTEMPTS; ++num_attempts) {
-                  if (S.properties.seeds.get_seed (method.pos, method.dir)) {
-                    if (!(method.check_seed() && method.init())) {
-                      track_excluded = true;
-                      tck.set_status (GeneratedTrack::status_t::SEED_REJECTED);
-                    }
-                    return true;
-                  }
-                }
-                FAIL ("Failed to find suitable seed point after " + str (MAX_NUM_SEED_ATTEMPTS) + " attempts - aborting");
-                return false;
 
+            bool get_seed ()
+            {
+              if (S.properties.seeds.is_finite())
+                return S.properties.seeds.get_seed (method.pos, method.dir);
+
+              for (size_t num_attempts = 0; num_attempts != MAX_NUM_SEED_ATTEMPTS; ++num_attempts) {
+                if (S.properties.seeds.get_seed (method.pos, method.dir))
+                  return true;
               }
+              FAIL ("Failed to find suitable seed point after " + str (MAX_NUM_SEED_ATTEMPTS) + " attempts - aborting");
+              return false;
             }
 
 
@@ -404,10 +414,8 @@ namespace MR
                   return true;
                 }
 
-                if (S.act().backtrack()) {
-                  for (const auto& i : tck)
-                    S.properties.include.contains (i, track_included);
-                }
+                if (S.act().backtrack())
+                  S.properties.include.contains (tck, track_included);
 
               }
 
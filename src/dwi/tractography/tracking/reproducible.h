@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#ifndef __dwi_tractography_tracking_reproducible_h__
+#define __dwi_tractography_tracking_reproducible_h__
+
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+
+#include "mrtrix.h"
+#include "math/rng.h"
+
+
+// Maximum number of seeds that may be drawn ahead of the last streamline
+//   to have been written to file in reproducible mode; this bounds the size
+//   of the buffer used to restore seed order in the writer
+#define TRACKING_REORDER_BUFFER_SIZE 1024
+
+// Base RNG seed used in reproducible mode if MRTRIX_RNG_SEED is not set
+#define TRACKING_REPRODUCIBLE_DEFAULT_RNG_SEED 0
+
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace Tracking
+      {
+
+
+        // Shared state for reproducible tracking: each seed is assigned a
+        //   sequential number, and the RNG of the tracking thread is
+        //   re-initialised from that number before the seed is drawn, such
+        //   that each streamline depends only on its seed number; the writer
+        //   then restores seed order, with tracking threads waiting rather
+        //   than drawing seeds too far ahead of it
+        class ReproducibleSeeding { MEMALIGN(ReproducibleSeeding)
+
+          public:
+            ReproducibleSeeding () :
+                base_seed (TRACKING_REPRODUCIBLE_DEFAULT_RNG_SEED),
+                next_seed (0),
+                next_written (0),
+                stopped (false)
+            {
+              const char* from_env = getenv ("MRTRIX_RNG_SEED");
+              if (from_env)
+                base_seed = to<std::mt19937::result_type> (from_env);
+            }
+
+
+            //! draw the next seed using \a functor, after re-seeding \a rng from its seed number
+            /*! For seeding mechanisms generating a finite number of seeds,
+             * the seeds themselves need to be drawn in order; otherwise, they
+             * may be drawn concurrently. Returns false if no seed was drawn
+             * or tracking has been terminated. */
+            template <class Functor>
+            bool get_seed (Functor&& functor, const bool finite, Math::RNG& rng, uint64_t& number)
+            {
+              {
+                std::lock_guard<std::mutex> lock (mutex);
+                number = next_seed;
+                if (finite) {
+                  reseed (rng, number);
+                  if (!functor())
+                    return false;
+                }
+                ++next_seed;
+              }
+              if (!finite) {
+                reseed (rng, number);
+                if (!functor()) {
+                  // A seed number that never reaches the writer would otherwise stall all other threads
+                  stop();
+                  return false;
+                }
+              }
+              std::unique_lock<std::mutex> lock (mutex);
+              condition.wait (lock, [&] { return stopped || number < next_written + TRACKING_REORDER_BUFFER_SIZE; });
+              return !stopped;
+            }
+
+
+            //! notify tracking threads that all streamlines preceding seed number \a next have been written
+            void written (const uint64_t next)
+            {
+              {
+                std::lock_guard<std::mutex> lock (mutex);
+                next_written = next;
+              }
+              condition.notify_all();
+            }
+
+            //! release any waiting tracking threads once no further streamlines are required
+            void stop ()
+            {
+              {
+                std::lock_guard<std::mutex> lock (mutex);
+                stopped = true;
+              }
+              condition.notify_all();
+            }
+
+
+          private:
+            std::mt19937::result_type base_seed;
+            uint64_t next_seed, next_written;
+            bool stopped;
+            std::mutex mutex;
+            std::condition_variable condition;
+
+            void reseed (Math::RNG& rng, const uint64_t number) const
+            {
+              std::seed_seq sequence { uint32_t (base_seed), uint32_t (number), uint32_t (number >> 32) };
+              rng.seed (sequence);
+            }
+
+        };
+
+
+      }
+    }
+  }
+}
+
+#endif
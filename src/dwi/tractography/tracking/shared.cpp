@@ -81,6 +81,12 @@ namespace MR
               throw Exception ("Cannot use -stop option if ACT backtracking is enabled");
           }
 
+          if (properties.find ("reproducible") != properties.end()) {
+            if (properties.find ("seed_dynamic") != properties.end())
+              throw Exception ("Reproducible tracking is not compatible with dynamic seeding");
+            reproducible_seeding.reset (new ReproducibleSeeding());
+          }
+
           if (properties.find ("downsample_factor") != properties.end())
             downsampler.set_ratio (to<int> (properties["downsample_factor"]));
 
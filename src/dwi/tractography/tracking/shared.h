@@ -26,6 +26,7 @@
 #include "dwi/tractography/roi.h"
 #include "dwi/tractography/ACT/shared.h"
 #include "dwi/tractography/resampling/downsampler.h"
+#include "dwi/tractography/tracking/reproducible.h"
 #include "dwi/tractography/tracking/types.h"
 #include "dwi/tractography/tracking/tractography.h"
 
@@ -69,6 +70,10 @@ namespace MR
             bool is_act() const { return bool (act_shared_additions); }
             const ACT::ACT_Shared_additions& act() const { return *act_shared_additions; }
 
+            // Additional members for reproducible tracking
+            bool is_reproducible() const { return bool (reproducible_seeding); }
+            ReproducibleSeeding& reproducible() const { return *reproducible_seeding; }
+
 
             float vox () const
             {
@@ -97,6 +102,7 @@ namespace MR
             mutable std::atomic<size_t> rejections  [REJECTION_REASON_COUNT];
 
             std::unique_ptr<ACT::ACT_Shared_additions> act_shared_additions;
+            std::unique_ptr<ReproducibleSeeding> reproducible_seeding;
 
 #ifdef DEBUG_TERMINATIONS
             Header debug_header;
@@ -83,7 +83,13 @@ namespace MR
 
       + Option ("downsample", "downsample the generated streamlines to reduce output file size "
                               "(default is (samples-1) for iFOD2, no downsampling for all other algorithms)")
-          + Argument ("factor").type_integer (2);
+          + Argument ("factor").type_integer (2)
+
+      + Option ("reproducible", "generate identical streamlines regardless of the number of threads, "
+                                "and write them in order of seeding, such that repeated runs produce the "
+                                "same output; the random number generator is seeded from the MRTRIX_RNG_SEED "
+                                "environment variable if set, or a fixed value otherwise "
+                                "(not compatible with dynamic seeding)");
 
 
 
@@ -142,6 +148,9 @@ namespace MR
         opt = get_options ("downsample");
         if (opt.size()) properties["downsample_factor"] = str<unsigned int> (opt[0][0]);
 
+        opt = get_options ("reproducible");
+        if (opt.size()) properties["reproducible"] = "1";
+
         opt = get_options ("grad");
         if (opt.size()) properties["DW_scheme"] = std::string (opt[0][0]);
 
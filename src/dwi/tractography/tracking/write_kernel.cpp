@@ -27,6 +27,31 @@ namespace MR
 
 
           bool WriteKernel::operator() (const GeneratedTrack& tck)
+          {
+            if (!S.is_reproducible())
+              return write (tck);
+
+            // Restore seed order before writing
+            if (tck.get_seed_number() != next_seed_number) {
+              reorder_buffer.insert (std::make_pair (tck.get_seed_number(), tck));
+              return true;
+            }
+            bool retval = write (tck);
+            ++next_seed_number;
+            for (auto next = reorder_buffer.begin();
+                 retval && next != reorder_buffer.end() && next->first == next_seed_number;
+                 next = reorder_buffer.erase (next), ++next_seed_number)
+              retval = write (next->second);
+            if (retval)
+              S.reproducible().written (next_seed_number);
+            else
+              S.reproducible().stop();
+            return retval;
+          }
+
+
+
+          bool WriteKernel::write (const GeneratedTrack& tck)
           {
             if (complete())
               return false;
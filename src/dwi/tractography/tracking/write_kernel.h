@@ -17,6 +17,7 @@
 #define __dwi_tractography_tracking_write_kernel_h__
 
 #include <cinttypes>
+#include <map>
 #include <string>
 
 #include "timer.h"
@@ -57,6 +58,7 @@ namespace MR
                 seeds (0),
                 streamlines (0),
                 selected (0),
+                next_seed_number (0),
                 progress (printf ("       0 seeds,        0 streamlines,        0 selected", 0, 0), always_increment ? S.max_num_seeds : S.max_num_tracks),
                 early_exit (shared)
           {
@@ -72,6 +74,8 @@ namespace MR
 
           ~WriteKernel ()
           {
+            if (S.is_reproducible())
+              S.reproducible().stop();
             // Use set_text() rather than update() here to force update of the text before progress goes out of scope
             progress.set_text (printf ("%8" PRIu64 " seeds, %8" PRIu64 " streamlines, %8" PRIu64 " selected", seeds, streamlines, selected));
             if (warn_on_max_seeds && writer.total_count == S.max_num_seeds
@@ -92,10 +96,15 @@ namespace MR
 
 
         protected:
+          bool write (const GeneratedTrack&);
+
+
           const SharedBase& S;
           Writer<> writer;
           const bool always_increment, warn_on_max_seeds;
           size_t seeds, streamlines, selected;
+          uint64_t next_seed_number;
+          std::map<uint64_t, GeneratedTrack> reorder_buffer;
           std::unique_ptr<File::OFStream> output_seeds;
           ProgressBar progress;
           EarlyExit early_exit;
@@ -356,7 +356,7 @@ namespace MR
         void Tractography::tractogram_open_slot ()
         {
 
-          vector<std::string> list = Dialog::File::get_files (this, "Select tractograms to open", "Tractograms (*.tck)");
+          vector<std::string> list = Dialog::File::get_files (this, "Select tractograms to open", "Tractograms (*.tck *.tcz)");
           add_tractogram(list);
         }
 
@@ -22,7 +22,7 @@ namespace MR
 
     using namespace App;
 
-    const char* initialisation_translation_choices[] = { "mass", "geometric", "none", nullptr };
+    const char* initialisation_translation_choices[] = { "mass", "geometric", "correlation", "none", nullptr };
     const char* initialisation_rotation_choices[] = { "search", "moments", "none", nullptr };
 
     const char* linear_metric_choices[] = { "diff", "ncc", nullptr };
@@ -62,6 +62,9 @@ namespace MR
             throw Exception ("init_rotation.search.scale has to be between 0.0001 and 1.0");
         registration.init.init_rotation.search.scale = scale;
       }
+      opt = get_options("init_rotation.search.levels");
+      if (opt.size())
+        registration.init.init_rotation.search.levels = size_t (opt[0][0]);
       opt = get_options("init_rotation.search.global.iterations");
       if (opt.size()) {
         size_t iters (opt[0][0]);
@@ -128,6 +131,9 @@ namespace MR
           registration.set_init_translation_type (Registration::Transform::Init::geometric);
           break;
         case 2:
+          registration.set_init_translation_type (Registration::Transform::Init::correlation);
+          break;
+        case 3:
           registration.set_init_translation_type (Registration::Transform::Init::none);
           break;
         default:
@@ -156,8 +162,8 @@ namespace MR
       OptionGroup ("Advanced linear transformation initialisation options")
 
       // translation options
-      + Option ("init_translation.unmasked1", "disregard mask1 for the translation initialisation (affects 'mass')")
-      + Option ("init_translation.unmasked2", "disregard mask2 for the translation initialisation (affects 'mass')")
+      + Option ("init_translation.unmasked1", "disregard mask1 for the translation initialisation (affects 'mass' and 'correlation')")
+      + Option ("init_translation.unmasked2", "disregard mask2 for the translation initialisation (affects 'mass' and 'correlation')")
 
       // rotation options
       + Option ("init_rotation.unmasked1", "disregard mask1 for the rotation initialisation (affects 'search' and 'moments')")
@@ -169,6 +175,11 @@ namespace MR
         + Argument ("scale").type_float (0.0001, 1.0)
       + Option ("init_rotation.search.directions", "number of rotation axis for local search. (Default: 250)")
         + Argument ("num").type_integer (1, 10000)
+      + Option ("init_rotation.search.levels", "number of resolution levels for the rotation search. "
+                                  "All candidate rotations are evaluated on the coarsest level; at each subsequent level, "
+                                  "the image resolution is doubled and only the better half of the remaining candidates is retained. "
+                                  "The finest level uses the resolution set by -init_rotation.search.scale. Values greater than 1 speed up the search but may select a different initial rotation. (Default: 1)")
+        + Argument ("num").type_integer (1, 10)
       + Option ("init_rotation.search.run_global", "perform a global search. (Default: local)")
       + Option ("init_rotation.search.global.iterations", "number of rotations to investigate (Default: 10000)")
         + Argument ("num").type_integer (1, 1e10);
@@ -215,7 +226,8 @@ namespace MR
       + Option ("rigid_init_translation", "initialise the translation and centre of rotation \n"
                                 "Valid choices are: \n"
                                 "mass (aligns the centers of mass of both images, default), \n"
-                                "geometric (aligns geometric image centres) and none.")
+                                "geometric (aligns geometric image centres), \n"
+                                "correlation (maximises the cross-correlation of both images over all translations, computed via the FFT) and none.")
         + Argument ("type").type_choice (initialisation_translation_choices)
 
       + Option ("rigid_init_rotation", "initialise the rotation "
@@ -282,7 +294,8 @@ namespace MR
       + Option ("affine_init_translation", "initialise the translation and centre of rotation \n"
                                 "Valid choices are: \n"
                                 "mass (aligns the centers of mass of both images), \n"
-                                "geometric (aligns geometric image centres) and none. (Default: mass)")
+                                "geometric (aligns geometric image centres), \n"
+                                "correlation (maximises the cross-correlation of both images over all translations, computed via the FFT) and none. (Default: mass)")
         + Argument ("type").type_choice (initialisation_translation_choices)
 
       + Option ("affine_init_rotation", "initialise the rotation "
@@ -322,6 +322,8 @@ namespace MR
               Transform::Init::initialise_using_image_mass (im1_image, im2_image, im1_mask, im2_mask, transform, init);
             else if (init_translation_type == Transform::Init::geometric)
               Transform::Init::initialise_using_image_centres (im1_image, im2_image, im1_mask, im2_mask, transform, init);
+            else if (init_translation_type == Transform::Init::correlation)
+              Transform::Init::initialise_using_correlation (im1_image, im2_image, im1_mask, im2_mask, transform, init);
             else if (init_translation_type == Transform::Init::set_centre_mass) // doesn't change translation or linear matrix
               Transform::Init::set_centre_via_mass (im1_image, im2_image, im1_mask, im2_mask, transform, init);
             else if (init_translation_type == Transform::Init::set_centre_geometric) // doesn't change translation or linear matrix
@@ -96,8 +96,8 @@ namespace MR
                 im2_image_reoriented = make_shared<Image<default_type>>(Image<default_type>::scratch (params.im2_image));
                 {
                    LogLevelLatch log_level (0);
-                  Registration::Transform::reorient (params.im1_image, *im1_image_reoriented, params.transformation.get_transform_half(), directions);
-                  Registration::Transform::reorient (params.im2_image, *im2_image_reoriented, params.transformation.get_transform_half_inverse(), directions);
+                  Registration::Transform::reorient (params.im1_image, *im1_image_reoriented, params.transformation.get_transform_half(), directions, FOD_to_aPSF_transform);
+                  Registration::Transform::reorient (params.im2_image, *im2_image_reoriented, params.transformation.get_transform_half_inverse(), directions, FOD_to_aPSF_transform);
                 }
                 params.set_im1_iterpolator (*im1_image_reoriented);
                 params.set_im2_iterpolator (*im2_image_reoriented);
@@ -220,8 +220,8 @@ namespace MR
                 im2_image_reoriented = make_shared<Image<default_type>>(Image<default_type>::scratch (params.im2_image));
                 {
                    LogLevelLatch log_level (0);
-                  Registration::Transform::reorient (params.im1_image, *im1_image_reoriented, params.transformation.get_transform_half(), directions);
-                  Registration::Transform::reorient (params.im2_image, *im2_image_reoriented, params.transformation.get_transform_half_inverse(), directions);
+                  Registration::Transform::reorient (params.im1_image, *im1_image_reoriented, params.transformation.get_transform_half(), directions, FOD_to_aPSF_transform);
+                  Registration::Transform::reorient (params.im2_image, *im2_image_reoriented, params.transformation.get_transform_half_inverse(), directions, FOD_to_aPSF_transform);
                 }
                 params.set_im1_iterpolator (*im1_image_reoriented);
                 params.set_im2_iterpolator (*im2_image_reoriented);
@@ -252,6 +252,7 @@ namespace MR
 
             void set_directions (Eigen::MatrixXd& dir) {
               directions = dir;
+              FOD_to_aPSF_transform = Registration::Transform::FOD_to_aPSF_weights_transform (params.im1_image.size(3), directions);
             }
 
           protected:
@@ -259,7 +260,7 @@ namespace MR
               ParamType params;
               vector<size_t> extent;
               size_t iteration;
-              Eigen::MatrixXd directions;
+              Eigen::MatrixXd directions, FOD_to_aPSF_transform;
               ssize_t overlap_count;
 
       };
@@ -178,6 +178,10 @@ namespace MR
                 }
               }
 
+              Eigen::MatrixXd FOD_to_aPSF_transform;
+              if (do_reorientation && fod_lmax[level])
+                FOD_to_aPSF_transform = Registration::Transform::FOD_to_aPSF_weights_transform (im1_smoothed.size(3), aPSF_directions);
+
               ssize_t iteration = 1;
               default_type grad_step_altered = gradient_step * (field_header.spacing(0) + field_header.spacing(1) + field_header.spacing(2)) / 3.0;
               default_type cost = std::numeric_limits<default_type>::max();
@@ -223,8 +227,8 @@ namespace MR
 
                 if (do_reorientation && fod_lmax[level]) {
                   DEBUG ("Reorienting FODs");
-                  Registration::Transform::reorient_warp (im1_warped, im1_deform_field, aPSF_directions);
-                  Registration::Transform::reorient_warp (im2_warped, im2_deform_field, aPSF_directions);
+                  Registration::Transform::reorient_warp (im1_warped, im1_deform_field, aPSF_directions, FOD_to_aPSF_transform);
+                  Registration::Transform::reorient_warp (im2_warped, im2_deform_field, aPSF_directions, FOD_to_aPSF_transform);
                 }
 
                 DEBUG ("warping mask images");
@@ -15,6 +15,11 @@
 
 #include "registration/transform/initialiser.h"
 #include "registration/transform/initialiser_helpers.h"
+#include "filter/fft.h"
+
+// maximum number of voxels along each axis of the images cross-correlated
+// for translation initialisation; larger images are sampled more coarsely:
+#define CORRELATION_INIT_MAX_SIZE 64
 
 namespace MR
 {
@@ -93,6 +98,68 @@ namespace MR
           transform.set_translation (translation);
         }
 
+        void initialise_using_correlation (
+          Image<default_type>& im1,
+          Image<default_type>& im2,
+          Image<default_type>& mask1,
+          Image<default_type>& mask2,
+          Registration::Transform::Base& transform,
+          Registration::Transform::Init::LinearInitialisationParams& init) {
+
+          CONSOLE ("initialising centre of rotation and translation using cross-correlation");
+          Image<default_type> bogus_mask;
+
+          // sample the first volume of both images on the field of view of
+          // image 1, at reduced resolution if necessary to limit the size of
+          // the transforms:
+          Header grid (im1);
+          grid.ndim() = 3;
+          default_type factor = 1.0;
+          for (size_t axis = 0; axis != 3; ++axis)
+            factor = std::max (factor, default_type (grid.size (axis)) / CORRELATION_INIT_MAX_SIZE);
+          for (size_t axis = 0; axis != 3; ++axis) {
+            grid.size (axis) = std::ceil (grid.size (axis) / factor);
+            grid.spacing (axis) *= factor;
+          }
+          auto image1 = Image<default_type>::scratch (grid, "image 1 for cross-correlation");
+          auto image2 = Image<default_type>::scratch (grid, "image 2 for cross-correlation");
+          sample_first_volume (im1, init.init_translation.unmasked1 ? bogus_mask : mask1, image1);
+          sample_first_volume (im2, init.init_translation.unmasked2 ? bogus_mask : mask2, image2);
+
+          // the peak of the cross-correlation gives the shift of image 2 onto
+          // image 1, relative to the centre voxel of the kernel (image 2):
+          Filter::FFTConvolution correlate (image1, image2, true);
+          auto correlation = Image<default_type>::scratch (correlate, "cross-correlation of images 1 and 2");
+          correlate (image1, correlation);
+
+          default_type peak = 0.0;
+          Eigen::Vector3 offset (Eigen::Vector3::Zero());
+          for (auto i = Loop (correlation) (correlation); i; ++i) {
+            if (correlation.value() > peak) {
+              peak = correlation.value();
+              for (size_t axis = 0; axis != 3; ++axis)
+                offset[axis] = correlation.index (axis) - correlation.size (axis) / 2;
+            }
+          }
+          if (!(peak > 0.0)) {
+            WARN ("images do not overlap at any offset; skipping translation initialisation");
+            return;
+          }
+
+          Eigen::Vector3 im1_centre;
+          get_geometric_centre (im1, im1_centre);
+          Eigen::Vector3 translation = MR::Transform (grid).voxel2scanner.linear() * offset;
+          Eigen::Vector3 centre = im1_centre - 0.5 * translation;
+          transform.set_centre_without_transform_update (centre);
+          transform.set_translation (translation);
+#ifdef DEBUG_INIT
+          VEC(offset);
+          VEC(centre);
+          VEC(translation);
+          transform.debug();
+#endif
+        }
+
         void initialise_using_image_moments (
           Image<default_type>& im1,
           Image<default_type>& im2,
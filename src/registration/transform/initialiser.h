@@ -29,7 +29,7 @@ namespace MR
     {
       namespace Init
       {
-        enum InitType {set_centre_mass, set_centre_geometric, mass, geometric, moments, rot_search, none};
+        enum InitType {set_centre_mass, set_centre_geometric, mass, geometric, correlation, moments, rot_search, none};
         struct LinearInitialisationParams { MEMALIGN(LinearInitialisationParams)
           struct TranslationInit { MEMALIGN(TranslationInit)
             bool unmasked1;
@@ -46,6 +46,7 @@ namespace MR
               vector<default_type> angles;
               default_type scale;
               size_t directions;
+              size_t levels;
               bool run_global;
               struct global_search { MEMALIGN(global_search)
                 size_t iterations;
@@ -57,6 +58,7 @@ namespace MR
                 angles (5),
                 scale (0.15),
                 directions (250),
+                levels (1),
                 run_global (false) {
                   angles[0] =  2.0 / 180.0 * Math::pi;
                   angles[1] =  5.0 / 180.0 * Math::pi;
@@ -98,6 +100,14 @@ namespace MR
           Registration::Transform::Base& transform,
           Registration::Transform::Init::LinearInitialisationParams& init);
 
+        extern void initialise_using_correlation (
+          Image<default_type>& im1,
+          Image<default_type>& im2,
+          Image<default_type>& mask1,
+          Image<default_type>& mask2,
+          Registration::Transform::Base& transform,
+          Registration::Transform::Init::LinearInitialisationParams& init);
+
         extern void initialise_using_image_moments (
           Image<default_type>& im1,
           Image<default_type>& im2,
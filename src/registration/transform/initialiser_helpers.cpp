@@ -20,6 +20,8 @@
 #include "registration/transform/search.h"
 
 #include "algo/loop.h"
+#include "interp/linear.h"
+#include "interp/nearest.h"
 #include "debug.h"
 // #include "timer.h"
 // #define DEBUG_INIT
@@ -174,6 +176,43 @@ namespace MR
           DEBUG ("centre of mass of " + im.name() + ": " + str(centre_of_mass.transpose()));
         }
 
+        // sample the first volume of im (within the mask, if valid) on the grid of sampled:
+        void sample_first_volume (Image<default_type>& im,
+                                  Image<default_type>& mask,
+                                  Image<default_type>& sampled) {
+          Interp::Linear<Image<default_type>> interp (im, 0.0);
+          for (size_t axis = 3; axis < interp.ndim(); ++axis)
+            interp.index (axis) = 0;
+          std::unique_ptr<Interp::Nearest<Image<default_type>>> interp_mask;
+          if (mask.valid())
+            interp_mask.reset (new Interp::Nearest<Image<default_type>> (mask, 0.0));
+
+          MR::Transform transform (sampled);
+          Eigen::Vector3 scanner;
+          Eigen::Vector3 voxel_pos;
+          default_type sum = 0.0;
+          size_t count = 0;
+          for (auto i = Loop (sampled) (sampled); i; ++i) {
+            voxel_pos << (default_type)sampled.index(0), (default_type)sampled.index(1), (default_type)sampled.index(2);
+            scanner = transform.voxel2scanner * voxel_pos;
+            default_type value = NaN;
+            if (interp.scanner (scanner) && (!interp_mask || (interp_mask->scanner (scanner) && interp_mask->value()))) {
+              value = interp.value();
+              if (std::isfinite (value)) {
+                sum += value;
+                ++count;
+              }
+            }
+            sampled.value() = value;
+          }
+
+          // subtract the mean over the sampled region, and set all other voxels
+          // to zero, so that the correlation is not dominated by the overlap:
+          const default_type mean = count ? sum / count : 0.0;
+          for (auto i = Loop (sampled) (sampled); i; ++i)
+            sampled.value() = std::isfinite (default_type (sampled.value())) ? sampled.value() - mean : 0.0;
+        }
+
         void initialise_using_rotation_search (
                                           Image<default_type>& im1,
                                           Image<default_type>& im2,
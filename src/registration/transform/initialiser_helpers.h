@@ -47,6 +47,10 @@ namespace MR
                                  Image<default_type>& mask,
                                  Eigen::Vector3& centre_of_mass);
 
+        void sample_first_volume (Image<default_type>& im,
+                                  Image<default_type>& mask,
+                                  Image<default_type>& sampled);
+
         bool get_sorted_eigen_vecs_vals (const Eigen::Matrix<default_type, 3, 3>& mat,
           Eigen::Matrix<default_type, Eigen::Dynamic, Eigen::Dynamic>& eigenvectors,
           Eigen::Matrix<default_type, Eigen::Dynamic, 1>& eigenvals);
@@ -41,6 +41,18 @@ namespace MR
 
 
 
+      //! the pseudo-inverse of aPSF_weights_to_FOD_transform(), mapping FOD coefficients onto aPSF weights
+      /*! This depends only on the number of SH coefficients and on the
+       * direction set; callers that reorient repeatedly with the same
+       * directions (e.g. at every iteration of a registration) should
+       * compute it once and pass it to reorient() or reorient_warp(). */
+      inline Eigen::MatrixXd FOD_to_aPSF_weights_transform (const int num_SH, const Eigen::MatrixXd& directions)
+      {
+        return Math::pinv (aPSF_weights_to_FOD_transform (num_SH, directions));
+      }
+
+
+
       template <class FODImageType>
       class LinearKernel { MEMALIGN(LinearKernel<FODImageType>)
 
@@ -48,6 +60,7 @@ namespace MR
           LinearKernel (const ssize_t n_SH,
                         const transform_type& linear_transform,
                         const Eigen::MatrixXd& directions,
+                        const Eigen::MatrixXd& FOD_to_aPSF_transform,
                         const bool modulate) : fod (n_SH)
           {
             Eigen::MatrixXd transformed_directions = linear_transform.linear().inverse() * directions;
@@ -56,11 +69,11 @@ namespace MR
               Eigen::VectorXd modulation_factors = transformed_directions.colwise().norm() / linear_transform.linear().inverse().determinant();
               transformed_directions.colwise().normalize();
               transform.noalias() = aPSF_weights_to_FOD_transform (n_SH, transformed_directions) * modulation_factors.asDiagonal()
-                                  * Math::pinv (aPSF_weights_to_FOD_transform (n_SH, directions));
+                                  * FOD_to_aPSF_transform;
             } else {
               transformed_directions.colwise().normalize();
               transform.noalias() = aPSF_weights_to_FOD_transform (n_SH, transformed_directions)
-                                  * Math::pinv (aPSF_weights_to_FOD_transform (n_SH, directions));
+                                  * FOD_to_aPSF_transform;
             }
           }
 
@@ -81,7 +94,8 @@ namespace MR
 
 
       /*
-      * reorient all FODs in an image with a linear transform.
+      * reorient all FODs in an image with a linear transform, using the
+      * precomputed FOD_to_aPSF_weights_transform() for these directions.
       * Note the input image can be the same as the output image
       */
       template <class FODImageType>
@@ -89,11 +103,12 @@ namespace MR
                      FODImageType& output_fod_image,
                      const transform_type& transform,
                      const Eigen::MatrixXd& directions,
+                     const Eigen::MatrixXd& FOD_to_aPSF_transform,
                      bool modulate = false)
       {
         assert (directions.cols() > directions.rows());
         ThreadedLoop (input_fod_image, 0, 3)
-            .run (LinearKernel<FODImageType>(input_fod_image.size(3), transform, directions, modulate), input_fod_image, output_fod_image);
+            .run (LinearKernel<FODImageType>(input_fod_image.size(3), transform, directions, FOD_to_aPSF_transform, modulate), input_fod_image, output_fod_image);
       }
 
 
@@ -110,23 +125,31 @@ namespace MR
                      bool modulate = false)
       {
         assert (directions.cols() > directions.rows());
+        const Eigen::MatrixXd FOD_to_aPSF_transform = FOD_to_aPSF_weights_transform (input_fod_image.size(3), directions);
         ThreadedLoop (progress_message, input_fod_image, 0, 3)
-            .run (LinearKernel<FODImageType>(input_fod_image.size(3), transform, directions, modulate), input_fod_image, output_fod_image);
+            .run (LinearKernel<FODImageType>(input_fod_image.size(3), transform, directions, FOD_to_aPSF_transform, modulate), input_fod_image, output_fod_image);
       }
 
 
 
 
+      // The reorientation matrix differs for every voxel, so rather than
+      // forming it explicitly (an n_SH x n_dirs x n_SH product per voxel),
+      // the FOD is decomposed into aPSF weights, which are then used to
+      // accumulate the aPSFs along the transformed directions directly.
       template <class FODImageType>
       class NonLinearKernel { MEMALIGN(NonLinearKernel<FODImageType>)
 
         public:
-          NonLinearKernel (const ssize_t n_SH, Image<default_type>& warp, const Eigen::MatrixXd& directions, const bool modulate) :
+          NonLinearKernel (const ssize_t n_SH, Image<default_type>& warp, const Eigen::MatrixXd& directions,
+                           const Eigen::MatrixXd& FOD_to_aPSF_transform, const bool modulate) :
                            n_SH (n_SH),
                            jacobian_adapter (warp),
                            directions (directions),
                            modulate (modulate),
-                           FOD_to_aPSF_transform (Math::pinv (aPSF_weights_to_FOD_transform (n_SH, directions))),
+                           FOD_to_aPSF_transform (FOD_to_aPSF_transform),
+                           lmax (Math::SH::LforN (n_SH)),
+                           aPSF_generator (lmax),
                            fod (n_SH) {}
 
 
@@ -135,24 +158,21 @@ namespace MR
             if (image.value() > 0) {  // only reorient voxels that contain a FOD
               for (size_t dim = 0; dim < 3; ++dim)
                 jacobian_adapter.index(dim) = image.index(dim);
-              Eigen::MatrixXd jacobian = jacobian_adapter.value().inverse().template cast<default_type>();
-              Eigen::MatrixXd transformed_directions = jacobian * directions;
-
-              if (modulate) {
-                Eigen::MatrixXd modulation_factors = transformed_directions.colwise().norm() / jacobian.determinant();
-                transformed_directions.colwise().normalize();
-
-                Eigen::MatrixXd temp = aPSF_weights_to_FOD_transform (n_SH, transformed_directions);
-                for (ssize_t i = 0; i < temp.cols(); ++i)
-                  temp.col(i) = temp.col(i) * modulation_factors(0,i);
-
-                transform.noalias() = temp * FOD_to_aPSF_transform;
-              } else {
-                transformed_directions.colwise().normalize();
-                transform.noalias() = aPSF_weights_to_FOD_transform (n_SH, transformed_directions) * FOD_to_aPSF_transform;
-              }
+              Eigen::Matrix<default_type,3,3> jacobian = jacobian_adapter.value().inverse().template cast<default_type>();
+              transformed_directions.noalias() = jacobian * directions;
+
               fod = image.row(3);
-              fod = transform * fod;
+              weights.noalias() = FOD_to_aPSF_transform * fod;
+              if (modulate)
+                weights.array() *= transformed_directions.colwise().norm().transpose().array() / jacobian.determinant();
+              transformed_directions.colwise().normalize();
+
+              // the aPSF is a delta function convolved with a fixed response,
+              // so the convolution can be applied once to the sum of deltas:
+              fod.setZero();
+              for (ssize_t i = 0; i < transformed_directions.cols(); ++i)
+                fod.noalias() += weights[i] * Math::SH::delta (delta, transformed_directions.col(i), lmax);
+              Math::SH::sconv (fod, aPSF_generator.RH_coefs());
               image.row(3) = fod;
             }
           }
@@ -161,9 +181,11 @@ namespace MR
             Adapter::Jacobian<Image<default_type> > jacobian_adapter;
             const Eigen::MatrixXd& directions;
             const bool modulate;
-            const Eigen::MatrixXd FOD_to_aPSF_transform;
-            Eigen::MatrixXd transform;
-            Eigen::VectorXd fod;
+            const Eigen::MatrixXd& FOD_to_aPSF_transform;
+            const int lmax;
+            const Math::SH::aPSF<default_type> aPSF_generator;
+            Eigen::Matrix<default_type,3,Eigen::Dynamic> transformed_directions;
+            Eigen::VectorXd fod, weights, delta;
       };
 
 
@@ -176,20 +198,22 @@ namespace MR
       {
         assert (directions.cols() > directions.rows());
         check_dimensions (fod_image, warp, 0, 3);
+        const Eigen::MatrixXd FOD_to_aPSF_transform = FOD_to_aPSF_weights_transform (fod_image.size(3), directions);
         ThreadedLoop (progress_message, fod_image, 0, 3)
-            .run (NonLinearKernel<FODImageType>(fod_image.size(3), warp, directions, modulate), fod_image);
+            .run (NonLinearKernel<FODImageType>(fod_image.size(3), warp, directions, FOD_to_aPSF_transform, modulate), fod_image);
       }
 
       template <class FODImageType>
       void reorient_warp (FODImageType& fod_image,
                           Image<default_type>& warp,
                           const Eigen::MatrixXd& directions,
+                          const Eigen::MatrixXd& FOD_to_aPSF_transform,
                           const bool modulate = false)
       {
         assert (directions.cols() > directions.rows());
         check_dimensions (fod_image, warp, 0, 3);
         ThreadedLoop (fod_image, 0, 3)
-            .run (NonLinearKernel<FODImageType>(fod_image.size(3), warp, directions, modulate), fod_image);
+            .run (NonLinearKernel<FODImageType>(fod_image.size(3), warp, directions, FOD_to_aPSF_transform, modulate), fod_image);
       }
 
 
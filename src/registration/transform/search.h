@@ -23,6 +23,7 @@
 #include "debug.h"
 #include "image.h"
 #include "progressbar.h"
+#include "thread_queue.h"
 #include "types.h"
 
 #include "math/math.h"
@@ -45,6 +46,9 @@
 #include "registration/transform/rigid.h"
 #include "file/config.h"
 
+// minimum size (in voxels) of the midway grid on which candidates can be discarded
+#define ROTATION_SEARCH_MIN_GRID_SIZE 12
+
 namespace MR
 {
   namespace Registration
@@ -82,6 +86,7 @@ namespace MR
             local_search_directions (init.init_rotation.search.directions),
             image_scale_factor (init.init_rotation.search.scale),
             global_search (init.init_rotation.search.run_global),
+            search_levels (std::max<size_t> (init.init_rotation.search.levels, 1)),
             idx_angle (0),
             idx_dir (0) {
               local_trafo.set_centre_without_transform_update (centre);
@@ -106,6 +111,7 @@ namespace MR
                                      Interp::Nearest<Image<default_type>>>;
 
             void write_images (const std::string& im1_path, const std::string& im2_path) {
+              const Header midway_image_header = get_midway_header (local_trafo);
               Image<default_type> image1_midway;
               Image<default_type> image2_midway;
 
@@ -130,85 +136,60 @@ namespace MR
               Filter::reslice<Interp::Cubic> (im2, image2_midway, local_trafo.get_transform_half_inverse(), Adapter::AutoOverSample, 0.0);
             }
 
+            // Candidate rotations are evaluated in parallel, each by a single
+            // thread, using successive halving: all candidates are first
+            // evaluated on a coarse midway grid, and only the better half is
+            // retained for evaluation at the next (twice finer) resolution,
+            // until the final resolution given by the search scale is reached.
             void run ( bool debug = false ) {
 
               std::string what = global_search? "global" : "local";
               size_t iterations = global_search? global_search_iterations : (rot_angles.size() * local_search_directions);
-              ProgressBar progress ("performing " + what + " search for best rotation", iterations);
-              overlap_it.resize (iterations);
-              cost_it.resize (iterations);
-              trafo_it.reserve (iterations);
 
-              if (!global_search) {
-                gen_uniform_rotation_axes (local_search_directions, 180.0); // full sphere
-                az_el_to_cartesian();
-              }
+              gen_candidates (iterations);
+              overlap_it = Eigen::Matrix<default_type, Eigen::Dynamic, 1>::Zero (iterations);
+              cost_it = Eigen::Matrix<default_type, Eigen::Dynamic, 1>::Constant (iterations, std::numeric_limits<default_type>::max());
 
-              size_t iteration (0);
-              ssize_t cnt (0);
-              Eigen::Matrix<default_type, Eigen::Dynamic, 1> gradient (local_trafo.size());
-              Eigen::VectorXd cost = Eigen::VectorXd::Zero(1,1);
-              transform_type T;
+              vector<size_t> candidates (iterations);
+              for (size_t i = 0; i < iterations; ++i)
+                candidates[i] = i;
+
+              // don't prune on grids too coarse to rank candidates meaningfully:
+              size_t levels = search_levels;
               {
-                ParamType parameters = get_parameters ();
-                // parameters.make_diagnostics_image ("/tmp/debugme"+str(iteration)+".mif", true); // REMOVEME
-                Metric::ThreadKernel<MetricType, ParamType> kernel (metric, parameters, cost, gradient, &cnt);
-                ThreadedLoop (parameters.midway_image, 0, 3).run (kernel);
-                assert (cnt > 0);
-                overlap_it[0] = cnt;
-                cost_it[0] = cost(0) / static_cast<default_type>(cnt);
-                T = parameters.transformation.get_transform();
-                trafo_it.push_back (T);
+                const Header midway_header = get_midway_header (local_trafo);
+                const ssize_t min_size = std::min (midway_header.size(0), std::min (midway_header.size(1), midway_header.size(2)));
+                while (levels > 1 && min_size * image_scale_factor / default_type (1 << (levels - 1)) < ROTATION_SEARCH_MIN_GRID_SIZE)
+                  --levels;
+                if (levels < search_levels)
+                  DEBUG ("rotation search: using " + str(levels) + " resolution levels");
               }
 
-              transform_type Tc2, To, R0;
-              Tc2.setIdentity();
-              To.setIdentity();
-              R0.setIdentity();
-              To.translation() = offset;
-              Tc2.translation() = centre - 0.5 * offset;
-
-
-              while ( ++iteration < iterations ) {
-                ++progress;
-                if (global_search)
-                  gen_random_quaternion ();
-                else
-                  gen_local_quaternion ();
-
-                R0.linear() = quat.normalized().toRotationMatrix();
-                transform_type T = Tc2 * To * R0 * Tc2.inverse();
-
-                local_trafo.set_transform<decltype(T)>(T);
-                ParamType parameters = get_parameters ();
-                // parameters.make_diagnostics_image ("/tmp/debugme"+str(iteration)+".mif", true); // REMOVEME
-                cost.fill(0);
-                cnt = 0;
-                Metric::ThreadKernel<MetricType, ParamType> kernel (metric, parameters, cost, gradient, &cnt);
-                ThreadedLoop (parameters.midway_image, 0, 3).run (kernel);
-                DEBUG ("rotation search: iteration " + str(iteration) + " cost: " + str(cost) + " cnt: " + str(cnt));
-                // write_images ( "im1_" + str(iteration) + ".mif", "im2_" + str(iteration) + ".mif");
-                if (cnt == 0)
-                  WARN ("rotation search: overlap count is zero");
-                overlap_it[iteration] = cnt;
-                cost_it[iteration] = cost(0) / static_cast<default_type>(cnt);
-                trafo_it.push_back (T);
+              size_t evaluations = 0;
+              for (size_t level = 0, n = iterations; level < levels; ++level, n = (n+1)/2)
+                evaluations += n;
+              ProgressBar progress ("performing " + what + " search for best rotation", evaluations);
+
+              for (size_t level = 0; level < levels; ++level) {
+                const default_type scale = image_scale_factor / default_type (1 << (levels - 1 - level));
+                CandidateSource source (candidates, progress);
+                CandidateEvaluator evaluator (*this, scale);
+                Thread::run_queue (source, size_t(), Thread::multi (evaluator));
+                DEBUG ("rotation search: evaluated " + str(candidates.size()) + " candidates at scale " + str(scale));
+                if (level + 1 < levels) {
+                  rank (candidates);
+                  candidates.resize ((candidates.size() + 1) / 2);
+                }
               }
+
               // if (debug) {
               //   save_matrix(cost_it, "/tmp/cost_before.txt");
               //   save_matrix(overlap_it, "/tmp/overlap.txt");
               // }
               //  best trafo := lowest cost per voxel with at least mean overlap
-              {
-                auto max_ = Eigen::MatrixXd::Constant(cost_it.rows(), 1, std::numeric_limits<default_type>::max());
-                default_type mean_overlap = static_cast<default_type>(overlap_it.sum()) / static_cast<default_type>(iterations);
-                // reject solutions with less than mean overlap by setting cost to max
-                cost_it = (overlap_it.array() > mean_overlap).select(cost_it, max_);
-                std::ptrdiff_t i;
-                min_cost = cost_it.minCoeff(&i);
-                T = trafo_it[i];
-                best_trafo = T;
-              }
+              rank (candidates);
+              best_trafo = trafo_it[candidates[0]];
+              min_cost = cost_it[candidates[0]];
               // if (debug) {
               //   save_matrix(cost_it, "/tmp/cost_after.txt");
               //   Eigen::VectorXd t(2);
@@ -219,17 +200,119 @@ namespace MR
               //   parameters.transformation.set_transform (best_trafo);
               //   write_images ( "/tmp/im1_best.mif", "/tmp/im2_best.mif");
               // }
+              local_trafo.set_transform<transform_type> (best_trafo);
               input_trafo.set_transform<transform_type> (best_trafo);
 
             };
 
           private:
-            FORCE_INLINE ParamType get_parameters () {
-              // create resized midway image
+
+            class CandidateSource { MEMALIGN(CandidateSource)
+              public:
+                CandidateSource (const vector<size_t>& candidates, ProgressBar& progress) :
+                  candidates (candidates),
+                  progress (progress),
+                  n (0) { }
+                bool operator() (size_t& index) {
+                  if (n == candidates.size())
+                    return false;
+                  index = candidates[n++];
+                  ++progress;
+                  return true;
+                }
+              private:
+                const vector<size_t>& candidates;
+                ProgressBar& progress;
+                size_t n;
+            };
+
+            class CandidateEvaluator { MEMALIGN(CandidateEvaluator)
+              public:
+                CandidateEvaluator (ExhaustiveRotationSearch& master, const default_type scale) :
+                  master (master),
+                  metric (master.metric),
+                  scale (scale) { }
+                bool operator() (const size_t& index) {
+                  master.evaluate (index, scale, metric);
+                  return true;
+                }
+              private:
+                ExhaustiveRotationSearch& master;
+                MetricType metric;
+                const default_type scale;
+            };
+
+            // evaluate the cost of a single candidate within the calling thread;
+            // each candidate writes only to its own entries in cost_it & overlap_it
+            void evaluate (const size_t index, const default_type scale, MetricType& thread_metric) {
+              Registration::Transform::Rigid trafo;
+              trafo.set_centre_without_transform_update (centre);
+              trafo.set_transform<transform_type> (trafo_it[index]);
+              ParamType parameters = get_parameters (trafo, scale);
+
+              Eigen::VectorXd cost = Eigen::VectorXd::Zero (1);
+              Eigen::VectorXd gradient = Eigen::VectorXd::Zero (trafo.size());
+              ssize_t cnt (0);
+              {
+                Metric::ThreadKernel<MetricType, ParamType> kernel (thread_metric, parameters, cost, gradient, &cnt);
+                Iterator iter (parameters.midway_image);
+                for (auto l = Loop (0, 3) (iter); l; ++l)
+                  kernel (iter);
+              }
+              if (cnt == 0)
+                DEBUG ("rotation search: overlap count is zero for candidate " + str(index));
+              overlap_it[index] = cnt;
+              cost_it[index] = cnt ? cost(0) / static_cast<default_type>(cnt) : std::numeric_limits<default_type>::max();
+            }
+
+            // sort candidates by cost per voxel, placing those with no more
+            // than the mean overlap (amongst these candidates) last
+            void rank (vector<size_t>& candidates) const {
+              default_type mean_overlap = 0.0;
+              for (auto i : candidates)
+                mean_overlap += overlap_it[i];
+              mean_overlap /= default_type (candidates.size());
+              std::stable_sort (candidates.begin(), candidates.end(), [&] (size_t a, size_t b) {
+                const bool a_overlaps = overlap_it[a] > mean_overlap;
+                const bool b_overlaps = overlap_it[b] > mean_overlap;
+                if (a_overlaps != b_overlaps)
+                  return a_overlaps;
+                return cost_it[a] < cost_it[b];
+              });
+            }
+
+            // candidate 0 is the input transformation
+            void gen_candidates (const size_t iterations) {
+              trafo_it.clear();
+              trafo_it.reserve (iterations);
+              if (!global_search) {
+                gen_uniform_rotation_axes (local_search_directions, 180.0); // full sphere
+                az_el_to_cartesian();
+              }
+
+              transform_type Tc2, To, R0;
+              Tc2.setIdentity();
+              To.setIdentity();
+              R0.setIdentity();
+              To.translation() = offset;
+              Tc2.translation() = centre - 0.5 * offset;
+
+              trafo_it.push_back (local_trafo.get_transform());
+              while (trafo_it.size() < iterations) {
+                if (global_search)
+                  gen_random_quaternion ();
+                else
+                  gen_local_quaternion ();
+                R0.linear() = quat.normalized().toRotationMatrix();
+                trafo_it.push_back (Tc2 * To * R0 * Tc2.inverse());
+              }
+            }
+
+            Header get_midway_header (Registration::Transform::Rigid& trafo) const {
               vector<Eigen::Transform<default_type, 3, Eigen::Projective>> init_transforms;
               {
-                Eigen::Transform<default_type, 3, Eigen::Projective> init_trafo_1 = local_trafo.get_transform_half_inverse();
-                Eigen::Transform<default_type, 3, Eigen::Projective> init_trafo_2 = local_trafo.get_transform_half();
+                Eigen::Transform<default_type, 3, Eigen::Projective> init_trafo_1 = trafo.get_transform_half_inverse();
+                Eigen::Transform<default_type, 3, Eigen::Projective> init_trafo_2 = trafo.get_transform_half();
                 init_transforms.push_back (init_trafo_1);
                 init_transforms.push_back (init_trafo_2);
               }
@@ -238,13 +321,16 @@ namespace MR
               vector<Header> headers;
               headers.push_back (Header (im1));
               headers.push_back (Header (im2));
-              midway_image_header = compute_minimum_average_header (headers, subsample, padding, init_transforms);
+              return compute_minimum_average_header (headers, subsample, padding, init_transforms);
+            }
 
-              Filter::Resize midway_resize_filter (midway_image_header);
-              midway_resize_filter.set_scale_factor (image_scale_factor);
-              midway_resized_header = Header (midway_resize_filter);
+            ParamType get_parameters (Registration::Transform::Rigid& trafo, const default_type scale) const {
+              Filter::Resize midway_resize_filter (get_midway_header (trafo));
+              midway_resize_filter.set_scale_factor (scale);
+              Header resized_header (midway_resize_filter);
 
-              ParamType parameters (local_trafo, im1, im2, midway_resized_header, mask1, mask2);
+              Image<default_type> image1 (im1), image2 (im2), image1_mask (mask1), image2_mask (mask2);
+              ParamType parameters (trafo, image1, image2, resized_header, image1_mask, image2_mask);
               parameters.loop_density = 1.0;
               return parameters;
             }
@@ -311,8 +397,7 @@ namespace MR
               ++idx_dir;
             }
 
-            Image<default_type> im1, im2, mask1, mask2, midway_image, midway_resized;
-            Header midway_resized_header;
+            Image<default_type> im1, im2, mask1, mask2;
             MetricType metric;
             Registration::Transform::Base& input_trafo;
             Registration::Transform::Init::LinearInitialisationParams& init_options;
@@ -322,7 +407,6 @@ namespace MR
             Math::RNG::Uniform<default_type> rnd;
             Eigen::Quaternion<default_type> quat;
             transform_type best_trafo;
-            Header midway_image_header;
             default_type min_cost;
             vector<default_type> vec_cost;
             vector<size_t> vec_overlap;
@@ -331,6 +415,7 @@ namespace MR
             size_t local_search_directions;
             default_type image_scale_factor;
             bool global_search;
+            size_t search_levels;
             size_t idx_angle, idx_dir;
             Registration::Transform::Rigid local_trafo;
             Eigen::Matrix<default_type, Eigen::Dynamic, 2> az_el;